@@ -270,6 +270,8 @@ private static void HandleResult(JpegLSError result)
                 case JpegLSError.UnexpectedEndOfImageMarker:
                 case JpegLSError.InvalidJpeglsPresetParameterType:
                 case JpegLSError.JpeglsPresetExtendedParameterTypeNotSupported:
+                case JpegLSError.RestartMarkerNotFound:
+                case JpegLSError.UnexpectedRestartMarker:
                 case JpegLSError.InvalidParameterWidth:
                 case JpegLSError.InvalidParameterHeight:
                 case JpegLSError.InvalidParameterComponentCount:
@@ -288,10 +290,12 @@ private static void HandleResult(JpegLSError result)
                 case JpegLSError.InvalidArgumentDestination:
                 case JpegLSError.InvalidArgumentSource:
                 case JpegLSError.InvalidArgumentThumbnail:
+                case JpegLSError.InvalidArgumentRestartInterval:
                     exception = new ArgumentException(GetErrorMessage(result));
                     break;
 
                 case JpegLSError.UnexpectedFailure:
+                case JpegLSError.InvalidOperation:
                     exception = new InvalidOperationException(GetErrorMessage(result));
                     break;
 
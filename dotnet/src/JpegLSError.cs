@@ -117,6 +117,21 @@ public enum JpegLSError
         /// </summary>
         JpeglsPresetExtendedParameterTypeNotSupported = 23,
 
+        /// <summary>
+        /// This error is returned when the stream doesn't contain the expected restart marker (RSTm) at the end of a restart interval.
+        /// </summary>
+        RestartMarkerNotFound = 24,
+
+        /// <summary>
+        /// This error is returned when the stream contains a restart marker (RSTm) outside the encoded data of a scan.
+        /// </summary>
+        UnexpectedRestartMarker = 25,
+
+        /// <summary>
+        /// This error is returned when a method call is invalid for the current state.
+        /// </summary>
+        InvalidOperation = 26,
+
         /// <summary>
         /// The argument for the width parameter is outside the range [1, 65535].
         /// </summary>
@@ -157,6 +172,11 @@ public enum JpegLSError
         /// </summary>
         InvalidArgumentThumbnail = 107,
 
+        /// <summary>
+        /// The argument for the restart interval is outside the range [0, 65535].
+        /// </summary>
+        InvalidArgumentRestartInterval = 108,
+
         /// <summary>
         /// This error is returned when the width parameter is defined more then once in an incompatible way.
         /// </summary>
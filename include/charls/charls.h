@@ -68,11 +68,446 @@ CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION JpegL
     const struct JlsParameters* params,
     const void* reserved);
 
+/// <summary>
+/// Handle of an encoder that can be reused to encode multiple images.
+/// The codec, quantization lookup table and line buffers of the last image are kept: encoding images with the same parameters is faster.
+/// </summary>
+typedef struct charls_jpegls_encoder charls_jpegls_encoder;
+
+/// <summary>
+/// Handle of a decoder that can be reused to decode multiple images.
+/// The codec, quantization lookup table and line buffers of the last image are kept: decoding images with the same parameters is faster.
+/// </summary>
+typedef struct charls_jpegls_decoder charls_jpegls_decoder;
+
+/// <summary>
+/// Creates a JPEG-LS encoder handle.
+/// </summary>
+/// <returns>The created encoder or NULL when there is not enough memory. Release it with charls_jpegls_encoder_destroy.</returns>
+CHARLS_API_IMPORT_EXPORT charls_jpegls_encoder* CHARLS_API_CALLING_CONVENTION charls_jpegls_encoder_create(void);
+
+/// <summary>
+/// Destroys a JPEG-LS encoder handle, NULL is allowed.
+/// </summary>
+CHARLS_API_IMPORT_EXPORT void CHARLS_API_CALLING_CONVENTION charls_jpegls_encoder_destroy(const charls_jpegls_encoder* encoder);
+
+/// <summary>
+/// Encodes a byte array with pixel data to a JPEG-LS encoded byte array, identical to JpegLsEncode.
+/// </summary>
+/// <param name="encoder">The encoder handle, can be reused for multiple images but not concurrently.</param>
+/// <param name="destination">Byte array that holds the encoded bytes when the function returns.</param>
+/// <param name="destination_size_bytes">Length of the array in bytes. If the array is too small the function will return an error.</param>
+/// <param name="bytes_written">This parameter will hold the number of bytes written to the destination byte array. Cannot be NULL.</param>
+/// <param name="source">Byte array that holds the pixels that should be encoded.</param>
+/// <param name="source_size_bytes">Length of the array in bytes.</param>
+/// <param name="params">Parameter object that describes the pixel data and how to encode it.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_encoder_encode(
+    charls_jpegls_encoder* encoder,
+    void* destination,
+    size_t destination_size_bytes,
+    size_t* bytes_written,
+    const void* source,
+    size_t source_size_bytes,
+    const struct JlsParameters* params);
+
+/// <summary>
+/// Called by the encoder when it needs memory to write encoded bytes to, for example a page of a send buffer or of a file mapping.
+/// </summary>
+/// <param name="user_context">The user context that was passed to charls_jpegls_encoder_encode_to_callback.</param>
+/// <param name="buffer_size_bytes">Will hold the size of the returned buffer in bytes.</param>
+/// <returns>The buffer or NULL when no memory is available (encoding fails with destination_buffer_too_small).</returns>
+typedef void* (CHARLS_API_CALLING_CONVENTION* charls_acquire_buffer_handler)(void* user_context, size_t* buffer_size_bytes);
+
+/// <summary>
+/// Called by the encoder when it is done with a buffer returned by the acquire buffer handler, also when encoding fails.
+/// </summary>
+/// <param name="user_context">The user context that was passed to charls_jpegls_encoder_encode_to_callback.</param>
+/// <param name="buffer">The buffer returned by the acquire buffer handler.</param>
+/// <param name="bytes_written">The number of encoded bytes at the start of the buffer.</param>
+typedef void (CHARLS_API_CALLING_CONVENTION* charls_release_buffer_handler)(void* user_context, void* buffer, size_t bytes_written);
+
+/// <summary>
+/// Encodes a byte array with pixel data into buffers of the application: the encoder writes the encoded bytes directly into them.
+/// The buffers are acquired and released in order, every buffer is filled completely except the last one.
+/// </summary>
+/// <param name="encoder">The encoder handle, can be reused for multiple images but not concurrently.</param>
+/// <param name="acquire_buffer">Function that provides the next buffer. Cannot be NULL.</param>
+/// <param name="release_buffer">Function that receives a filled buffer. Cannot be NULL.</param>
+/// <param name="user_context">Passed unchanged to the acquire and release functions.</param>
+/// <param name="bytes_written">This parameter will hold the total number of encoded bytes. Cannot be NULL.</param>
+/// <param name="source">Byte array that holds the pixels that should be encoded.</param>
+/// <param name="source_size_bytes">Length of the array in bytes.</param>
+/// <param name="params">Parameter object that describes the pixel data and how to encode it.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_encoder_encode_to_callback(
+    charls_jpegls_encoder* encoder,
+    charls_acquire_buffer_handler acquire_buffer,
+    charls_release_buffer_handler release_buffer,
+    void* user_context,
+    size_t* bytes_written,
+    const void* source,
+    size_t source_size_bytes,
+    const struct JlsParameters* params);
+
+/// <summary>
+/// Computes the maximum size of the encoded image (including all marker segments), a destination of this size is never too small.
+/// The size includes the restart markers of a restart interval of 1 line: it is valid for every restart interval.
+/// Incompressible images are coded with more bits than their samples: the size is larger than the size of the pixels.
+/// </summary>
+/// <param name="params">Parameter object that describes the pixel data and how to encode it.</param>
+/// <param name="size_in_bytes">This parameter will hold the maximum size in bytes. Cannot be NULL.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_encoder_get_estimated_destination_size(
+    const struct JlsParameters* params,
+    size_t* size_in_bytes);
+
+/// <summary>
+/// Sets a buffer from which the encode calls of the handle allocate all their memory: no heap memory is used.
+/// The buffer is reused by every call, images are then encoded on the calling thread only (the thread count is ignored).
+/// A call fails with not_enough_memory when the buffer is too small, see charls_get_scratch_size.
+/// </summary>
+/// <param name="encoder">The encoder handle.</param>
+/// <param name="buffer">The buffer, it must stay valid while it is set. NULL removes the buffer: the heap is used again.</param>
+/// <param name="buffer_size_bytes">The size of the buffer in bytes.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_encoder_set_scratch_buffer(
+    charls_jpegls_encoder* encoder,
+    void* buffer,
+    size_t buffer_size_bytes);
+
+/// <summary>
+/// Sets the maximum number of threads that the encode calls of the handle can use (including the calling thread), the default is 0.
+/// The component scans of a non interleaved image and the restart intervals of a scan are then encoded concurrently,
+/// the encoded bytes are identical to sequential encoding. The value 0 or 1 encodes on the calling thread only.
+/// </summary>
+/// <param name="encoder">The encoder handle.</param>
+/// <param name="thread_count">The maximum number of threads, cannot be negative.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_encoder_set_thread_count(
+    charls_jpegls_encoder* encoder,
+    int32_t thread_count);
+
+/// <summary>
+/// Sets the number of lines in a restart interval (DRI segment, see ITU T.81, B.2.4.4) of the images that the handle encodes, the default is 0:
+/// no restart markers. At the end of every restart interval the encoded bits are padded to a byte boundary, a restart marker (RSTm) is
+/// inserted and the coding state is reset: restart intervals can be encoded and decoded independently.
+/// </summary>
+/// <param name="encoder">The encoder handle.</param>
+/// <param name="restart_interval">The number of lines in a restart interval, in the range [0, 65535].</param>
+/// <returns>Success or invalid_argument_restart_interval when the value is outside the range.</returns>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_encoder_set_restart_interval(
+    charls_jpegls_encoder* encoder,
+    int32_t restart_interval);
+
+/// <summary>
+/// Creates a JPEG-LS decoder handle.
+/// </summary>
+/// <returns>The created decoder or NULL when there is not enough memory. Release it with charls_jpegls_decoder_destroy.</returns>
+CHARLS_API_IMPORT_EXPORT charls_jpegls_decoder* CHARLS_API_CALLING_CONVENTION charls_jpegls_decoder_create(void);
+
+/// <summary>
+/// Destroys a JPEG-LS decoder handle, NULL is allowed.
+/// </summary>
+CHARLS_API_IMPORT_EXPORT void CHARLS_API_CALLING_CONVENTION charls_jpegls_decoder_destroy(const charls_jpegls_decoder* decoder);
+
+/// <summary>
+/// Decodes a JPEG-LS encoded byte array to uncompressed pixel data byte array, identical to JpegLsDecode.
+/// </summary>
+/// <param name="decoder">The decoder handle, can be reused for multiple images but not concurrently.</param>
+/// <param name="destination">Byte array that holds the uncompressed pixel data bytes when the function returns.</param>
+/// <param name="destination_size_bytes">Length of the array in bytes. If the array is too small the function will return an error.</param>
+/// <param name="source">Byte array that holds the JPEG-LS encoded data that should be decoded.</param>
+/// <param name="source_size_bytes">Length of the array in bytes.</param>
+/// <param name="params">Parameter object that describes the pixel data and how to decode it, can be NULL.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_decoder_decode(
+    charls_jpegls_decoder* decoder,
+    void* destination,
+    size_t destination_size_bytes,
+    const void* source,
+    size_t source_size_bytes,
+    const struct JlsParameters* params);
+
+/// <summary>
+/// Decodes a region of interest and/or a subset of the components of a JPEG-LS image.
+/// Decoding stops after the last line of the region: the encoded data of the lines below it is skipped with a marker search.
+/// The scans of non interleaved components that are not selected are skipped completely.
+/// </summary>
+/// <param name="decoder">The decoder handle, can be reused for multiple images but not concurrently.</param>
+/// <param name="destination">Byte array that holds the decoded pixels of the region and the selected components when the function returns.</param>
+/// <param name="destination_size_bytes">Length of the array in bytes. If the array is too small the function will return an error.</param>
+/// <param name="source">Byte array that holds the JPEG-LS encoded data.</param>
+/// <param name="source_size_bytes">Length of the array in bytes.</param>
+/// <param name="region">The region of interest, NULL decodes the complete image.</param>
+/// <param name="component_mask">
+/// The components to decode, bit i selects component i (0 selects all). The selected components of an interleaved image are written
+/// pixel interleaved without padding, the stride is not used.
+/// </param>
+/// <param name="params">Parameter object that describes the pixel data and how to decode it, can be NULL.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_decoder_decode_region(
+    charls_jpegls_decoder* decoder,
+    void* destination,
+    size_t destination_size_bytes,
+    const void* source,
+    size_t source_size_bytes,
+    const struct JlsRect* region,
+    uint32_t component_mask,
+    const struct JlsParameters* params);
+
+/// <summary>
+/// A part of a JPEG-LS stream that is split into multiple buffers, for example the fragments of DICOM encapsulated pixel data.
+/// </summary>
+typedef struct charls_buffer_fragment
+{
+    const void* data;
+    size_t size_bytes;
+} charls_buffer_fragment;
+
+/// <summary>
+/// Decodes a JPEG-LS stream that is split into fragments, the fragments are read in place (without concatenating them first).
+/// </summary>
+/// <param name="decoder">The decoder handle, can be reused for multiple images but not concurrently.</param>
+/// <param name="destination">Byte array that holds the uncompressed pixel data bytes when the function returns.</param>
+/// <param name="destination_size_bytes">Length of the array in bytes. If the array is too small the function will return an error.</param>
+/// <param name="fragments">The fragments of the JPEG-LS encoded data, in stream order. Fragments can have any size (also 0).</param>
+/// <param name="fragment_count">The number of fragments.</param>
+/// <param name="params">Parameter object that describes the pixel data and how to decode it, can be NULL.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_decoder_decode_fragments(
+    charls_jpegls_decoder* decoder,
+    void* destination,
+    size_t destination_size_bytes,
+    const charls_buffer_fragment* fragments,
+    size_t fragment_count,
+    const struct JlsParameters* params);
+
+/// <summary>
+/// Reads the JPEG-LS header up to the encoded data of the first scan and keeps the parsed state in the decoder.
+/// A next call to charls_jpegls_decoder_decode_to_buffer starts directly at the encoded data, the header is not parsed again.
+/// </summary>
+/// <param name="decoder">The decoder handle.</param>
+/// <param name="source">Byte array that holds the JPEG-LS encoded data, must remain valid until the last decode_to_buffer call.</param>
+/// <param name="source_size_bytes">Length of the array in bytes.</param>
+/// <param name="params">Parameter object that receives the parameters of the image.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_decoder_read_header(
+    charls_jpegls_decoder* decoder,
+    const void* source,
+    size_t source_size_bytes,
+    struct JlsParameters* params);
+
+/// <summary>
+/// Decodes the image of which the header was read by charls_jpegls_decoder_read_header.
+/// </summary>
+/// <param name="decoder">The decoder handle.</param>
+/// <param name="destination">Byte array that holds the uncompressed pixel data bytes when the function returns.</param>
+/// <param name="destination_size_bytes">Length of the array in bytes. If the array is too small the function will return an error.</param>
+/// <param name="params">Decoding options, can be NULL. Only stride and outputBgr are used.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_decoder_decode_to_buffer(
+    charls_jpegls_decoder* decoder,
+    void* destination,
+    size_t destination_size_bytes,
+    const struct JlsParameters* params);
+
+/// <summary>
+/// Sets a buffer from which the decode calls of the handle allocate all their memory: no heap memory is used.
+/// The buffer is reused by every call, images are then decoded on the calling thread only (the thread count is ignored).
+/// A call fails with not_enough_memory when the buffer is too small, see charls_get_scratch_size.
+/// </summary>
+/// <param name="decoder">The decoder handle.</param>
+/// <param name="buffer">The buffer, it must stay valid while it is set. NULL removes the buffer: the heap is used again.</param>
+/// <param name="buffer_size_bytes">The size of the buffer in bytes.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_decoder_set_scratch_buffer(
+    charls_jpegls_decoder* decoder,
+    void* buffer,
+    size_t buffer_size_bytes);
+
+/// <summary>
+/// Sets the maximum number of threads that the decode calls of the handle can use (including the calling thread), the default is 0.
+/// The component scans of a non interleaved image and the restart intervals of a scan are then decoded concurrently.
+/// The value 0 or 1 decodes on the calling thread only.
+/// </summary>
+/// <param name="decoder">The decoder handle.</param>
+/// <param name="thread_count">The maximum number of threads, cannot be negative.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_decoder_set_thread_count(
+    charls_jpegls_decoder* decoder,
+    int32_t thread_count);
+
+/// <summary>
+/// Handle of a decoder that decodes a JPEG-LS stream while it is received (progressive display over slow links).
+/// The received bytes are appended and every line of which all encoded bytes are available is decoded and written to the destination.
+/// </summary>
+typedef struct charls_jpegls_incremental_decoder charls_jpegls_incremental_decoder;
+
+/// <summary>
+/// Creates an incremental JPEG-LS decoder.
+/// </summary>
+/// <returns>The created decoder or NULL when there is not enough memory. Release it with charls_jpegls_incremental_decoder_destroy.</returns>
+CHARLS_API_IMPORT_EXPORT charls_jpegls_incremental_decoder* CHARLS_API_CALLING_CONVENTION charls_jpegls_incremental_decoder_create(void);
+
+/// <summary>
+/// Destroys an incremental JPEG-LS decoder, NULL is allowed.
+/// </summary>
+CHARLS_API_IMPORT_EXPORT void CHARLS_API_CALLING_CONVENTION charls_jpegls_incremental_decoder_destroy(const charls_jpegls_incremental_decoder* decoder);
+
+/// <summary>
+/// Appends received bytes of the JPEG-LS stream (they are copied) and decodes as far as possible without blocking.
+/// </summary>
+/// <param name="decoder">The incremental decoder.</param>
+/// <param name="source">The received bytes.</param>
+/// <param name="source_size_bytes">The number of received bytes.</param>
+/// <returns>Success (also when more bytes are needed) or the error of the stream, an error is final.</returns>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_incremental_decoder_append(
+    charls_jpegls_incremental_decoder* decoder,
+    const void* source,
+    size_t source_size_bytes);
+
+/// <summary>
+/// Retrieves the parameters of the image, available when the header up to the first scan has been received.
+/// </summary>
+/// <param name="decoder">The incremental decoder.</param>
+/// <param name="params">Parameter object that receives the parameters of the image.</param>
+/// <returns>Success or source_buffer_too_small when the header has not been received yet.</returns>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_incremental_decoder_get_parameters(
+    const charls_jpegls_incremental_decoder* decoder,
+    struct JlsParameters* params);
+
+/// <summary>
+/// Sets the destination of the decoded pixels (after the parameters are available), it must remain valid until decoding is complete.
+/// </summary>
+/// <param name="decoder">The incremental decoder.</param>
+/// <param name="destination">Byte array that receives the decoded lines.</param>
+/// <param name="destination_size_bytes">Length of the array in bytes.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_incremental_decoder_set_destination(
+    charls_jpegls_incremental_decoder* decoder,
+    void* destination,
+    size_t destination_size_bytes);
+
+/// <summary>
+/// Retrieves how far the image has been decoded: the lines of the completed scans and the first lines of the current scan are in the destination.
+/// </summary>
+/// <param name="decoder">The incremental decoder.</param>
+/// <param name="completed_scan_count">Receives the number of completed scans (a non interleaved image has a scan per component).</param>
+/// <param name="decoded_line_count">Receives the number of decoded lines of the current scan.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_incremental_decoder_get_progress(
+    const charls_jpegls_incremental_decoder* decoder,
+    int32_t* completed_scan_count,
+    int32_t* decoded_line_count);
+
+/// <summary>
+/// Signals that all bytes have been appended and decodes the remaining lines.
+/// </summary>
+/// <param name="decoder">The incremental decoder.</param>
+/// <returns>Success when the complete image has been decoded, source_buffer_too_small when the stream is incomplete.</returns>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_incremental_decoder_finish(
+    charls_jpegls_incremental_decoder* decoder);
+
+/// <summary>
+/// Handle of an encoder that encodes an image while its lines are produced (push model), for example by an acquisition device.
+/// Every pushed line is encoded immediately and the encoded bytes are written into buffers provided by the application.
+/// </summary>
+typedef struct charls_jpegls_incremental_encoder charls_jpegls_incremental_encoder;
+
+/// <summary>
+/// Creates an incremental JPEG-LS encoder, it can encode multiple images (one at a time).
+/// </summary>
+/// <returns>The created encoder or NULL when there is not enough memory. Release it with charls_jpegls_incremental_encoder_destroy.</returns>
+CHARLS_API_IMPORT_EXPORT charls_jpegls_incremental_encoder* CHARLS_API_CALLING_CONVENTION charls_jpegls_incremental_encoder_create(void);
+
+/// <summary>
+/// Destroys an incremental JPEG-LS encoder, NULL is allowed. The buffer of an unfinished image is released.
+/// </summary>
+CHARLS_API_IMPORT_EXPORT void CHARLS_API_CALLING_CONVENTION charls_jpegls_incremental_encoder_destroy(const charls_jpegls_incremental_encoder* encoder);
+
+/// <summary>
+/// Sets the number of lines in a restart interval of the images that are started after this call, the default is 0: no restart markers.
+/// </summary>
+/// <param name="encoder">The incremental encoder.</param>
+/// <param name="restart_interval">The number of lines in a restart interval, in the range [0, 65535].</param>
+/// <returns>Success or invalid_argument_restart_interval when the value is outside the range.</returns>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_incremental_encoder_set_restart_interval(
+    charls_jpegls_incremental_encoder* encoder,
+    int32_t restart_interval);
+
+/// <summary>
+/// Starts the encoding of an image and writes its header. The image must have a single scan:
+/// a single component or interleaved components (InterleaveMode::Line or InterleaveMode::Sample).
+/// </summary>
+/// <param name="encoder">The incremental encoder.</param>
+/// <param name="params">Parameter object that describes the pixel data and how to encode it.</param>
+/// <param name="acquire_buffer">Called when a buffer is needed for the encoded bytes.</param>
+/// <param name="release_buffer">Called when a buffer is full or when the image is finished.</param>
+/// <param name="user_context">Passed to the callbacks.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_incremental_encoder_begin(
+    charls_jpegls_incremental_encoder* encoder,
+    const struct JlsParameters* params,
+    charls_acquire_buffer_handler acquire_buffer,
+    charls_release_buffer_handler release_buffer,
+    void* user_context);
+
+/// <summary>
+/// Encodes the next lines of the image, the source is no longer used when the function returns.
+/// </summary>
+/// <param name="encoder">The incremental encoder.</param>
+/// <param name="source">Byte array that holds the lines, a line starts every params.stride bytes.</param>
+/// <param name="source_size_bytes">Length of the array in bytes.</param>
+/// <param name="line_count">The number of lines in the array.</param>
+/// <returns>Success or the error, the image is abandoned when encoding of the lines fails.</returns>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_incremental_encoder_push_lines(
+    charls_jpegls_incremental_encoder* encoder,
+    const void* source,
+    size_t source_size_bytes,
+    int32_t line_count);
+
+/// <summary>
+/// Ends the image after all its lines are pushed, the last buffer is released.
+/// </summary>
+/// <param name="encoder">The incremental encoder.</param>
+/// <param name="bytes_written">Receives the size of the encoded image.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_jpegls_incremental_encoder_finish(
+    charls_jpegls_incremental_encoder* encoder,
+    size_t* bytes_written);
+
+/// <summary>
+/// Computes the size of a scratch buffer that is large enough to encode or decode an image with an encoder or decoder handle.
+/// </summary>
+/// <param name="params">The parameters of the image: the parameters to encode it or the parameters returned by read header.</param>
+/// <param name="size_in_bytes">This parameter will hold the size in bytes. Cannot be NULL.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_get_scratch_size(
+    const struct JlsParameters* params,
+    size_t* size_in_bytes);
+
+/// <summary>
+/// Called by the codec to allocate memory. It can be called concurrently by the threads that encode or decode.
+/// </summary>
+/// <param name="user_context">The user context that was passed to charls_set_allocator.</param>
+/// <param name="size_bytes">The size of the memory in bytes.</param>
+/// <returns>Memory aligned for any type (as returned by malloc) or NULL when no memory is available (the call fails with not_enough_memory).</returns>
+typedef void* (CHARLS_API_CALLING_CONVENTION* charls_allocate_handler)(void* user_context, size_t size_bytes);
+
+/// <summary>
+/// Called by the codec to release memory returned by the allocate handler.
+/// </summary>
+/// <param name="user_context">The user context that was passed to charls_set_allocator.</param>
+/// <param name="memory">The memory to release.</param>
+typedef void (CHARLS_API_CALLING_CONVENTION* charls_free_handler)(void* user_context, void* memory);
+
+/// <summary>
+/// Sets the allocator that the codec uses for its memory (codecs, line buffers and lookup tables) when no scratch buffer is set.
+/// It must be set before any handle is used and is not synchronized with running calls: typically once at startup.
+/// The quantization lookup tables of near-lossless coding and custom thresholds are not allocated with it: they are kept in a
+/// process-wide cache that is shared by all handles and outlives the allocator, it uses operator new.
+/// </summary>
+/// <param name="allocate">The allocate handler, NULL together with free restores the default allocator (operator new).</param>
+/// <param name="free">The free handler, NULL together with allocate restores the default allocator (operator delete).</param>
+/// <param name="user_context">Passed to the handlers.</param>
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType CHARLS_API_CALLING_CONVENTION charls_set_allocator(
+    charls_allocate_handler allocate,
+    charls_free_handler free,
+    void* user_context);
+
 #ifdef __cplusplus
 }
 
 CHARLS_API_IMPORT_EXPORT CharlsApiResultType JpegLsEncodeStream(ByteStreamInfo destination, size_t& bytesWritten, ByteStreamInfo source, const JlsParameters& params);
 CHARLS_API_IMPORT_EXPORT CharlsApiResultType JpegLsDecodeStream(ByteStreamInfo destination, ByteStreamInfo source, const JlsParameters* params);
 CHARLS_API_IMPORT_EXPORT CharlsApiResultType JpegLsReadHeaderStream(ByteStreamInfo source, JlsParameters* params);
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType charls_jpegls_encoder_encode_stream(charls_jpegls_encoder* encoder, ByteStreamInfo destination, size_t& bytesWritten,
+                                                                                ByteStreamInfo source, const JlsParameters& params);
+CHARLS_API_IMPORT_EXPORT CharlsApiResultType charls_jpegls_decoder_decode_stream(charls_jpegls_decoder* decoder, ByteStreamInfo destination,
+                                                                                ByteStreamInfo source, const JlsParameters* params);
 
 #endif
@@ -5,6 +5,8 @@
 #include <vector>
 #include <cstddef>
 #include <filesystem>
+#include <memory>
+#include <new>
 
 // WARNING: THESE CLASSES ARE NOT FINAL AND THEIR DESIGN AND API MAY CHANGE
 
@@ -24,6 +26,16 @@ struct metadata_info_t
 class jpegls_decoder final
 {
 public:
+    /// <summary>
+    /// Creates the decoder, the same decoder can be used to decode multiple images: the codec of the last image is kept.
+    /// </summary>
+    jpegls_decoder() :
+        decoder_{charls_jpegls_decoder_create()}
+    {
+        if (!decoder_)
+            throw std::bad_alloc();
+    }
+
     void read_header(const void* source, const size_t source_size_bytes)
     {
         std::error_code ec;
@@ -34,12 +46,11 @@ class jpegls_decoder final
 
     void read_header(const void* source, const size_t source_size_bytes, std::error_code& error) noexcept
     {
-        error = JpegLsReadHeader(source, source_size_bytes, &params_, nullptr);
+        // The decoder keeps the parsed header: decode continues at the encoded data of the first scan.
+        error = charls_jpegls_decoder_read_header(decoder_.get(), source, source_size_bytes, &params_);
         if (error)
             return;
 
-        source_ = source;
-        source_size_bytes_ = source_size_bytes;
         metadata_ = { params_.width, params_.height, params_.bitsPerSample, params_.components };
     }
 
@@ -58,7 +69,14 @@ class jpegls_decoder final
 
     void decode(void* destination, const size_t destination_size_bytes, std::error_code& error) const noexcept
     {
-        error = JpegLsDecode(destination, destination_size_bytes, source_, source_size_bytes_, &params_, nullptr);
+        error = charls_jpegls_decoder_decode_to_buffer(decoder_.get(), destination, destination_size_bytes, &params_);
+    }
+
+    void thread_count(int value)
+    {
+        const std::error_code error = charls_jpegls_decoder_set_thread_count(decoder_.get(), value);
+        if (error)
+            throw jpegls_error(error);
     }
 
     size_t required_size() const noexcept
@@ -67,8 +85,15 @@ class jpegls_decoder final
     }
 
 private:
-    const void* source_{};
-    size_t source_size_bytes_{};
+    struct decoder_deleter
+    {
+        void operator()(const charls_jpegls_decoder* decoder) const noexcept
+        {
+            charls_jpegls_decoder_destroy(decoder);
+        }
+    };
+
+    std::unique_ptr<charls_jpegls_decoder, decoder_deleter> decoder_;
     JlsParameters params_{};
     metadata_info_t metadata_{};
 };
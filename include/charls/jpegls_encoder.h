@@ -4,6 +4,9 @@
 
 #include <vector>
 #include <cstddef>
+#include <streambuf>
+#include <memory>
+#include <new>
 
 // WARNING: THESE CLASSES ARE NOT FINAL AND THEIR DESIGN AND API MAY CHANGE
 
@@ -22,6 +25,16 @@ struct metadata
 class jpegls_encoder final
 {
 public:
+    /// <summary>
+    /// Creates the encoder, the same encoder can be used to encode multiple images: the codec of the last image is kept.
+    /// </summary>
+    jpegls_encoder() :
+        encoder_{charls_jpegls_encoder_create()}
+    {
+        if (!encoder_)
+            throw std::bad_alloc();
+    }
+
     void source(const void* source, size_t source_size_bytes, const metadata& metadata) noexcept
     {
         source_ = source,
@@ -39,17 +52,69 @@ class jpegls_encoder final
         allowed_lossy_error_ = value;
     }
 
-    std::vector<std::byte> encode()
+    void thread_count(int value)
     {
-        // Assume that compressed pixels are smaller or equal to uncompressed pixels and reserve some room for JPEG header.
-        const size_t encoded_buffer_size = source_size_bytes_ + 1024;
+        const std::error_code error = charls_jpegls_encoder_set_thread_count(encoder_.get(), value);
+        if (error)
+            throw jpegls_error(error);
+    }
 
-        std::vector<std::byte> buffer(encoded_buffer_size);
-        buffer.resize(encode(buffer.data(), buffer.size()));
+    void restart_interval(int value)
+    {
+        const std::error_code error = charls_jpegls_encoder_set_restart_interval(encoder_.get(), value);
+        if (error)
+            throw jpegls_error(error);
+    }
+
+    /// <summary>
+    /// Returns the size of a destination that is always large enough for the encoded image.
+    /// </summary>
+    size_t estimated_destination_size() const
+    {
+        size_t size_in_bytes;
+        const JlsParameters parameters{get_parameters()};
+        const std::error_code error = charls_jpegls_encoder_get_estimated_destination_size(&parameters, &size_in_bytes);
+        if (error)
+            throw jpegls_error(error);
+
+        return size_in_bytes;
+    }
+
+    std::vector<std::byte> encode()
+    {
+        // Assume that compressed pixels are smaller or equal to uncompressed pixels, the buffer grows when they are not.
+        std::vector<std::byte> buffer;
+        buffer.reserve(source_size_bytes_ + 1024);
+        encode(buffer);
 
         return buffer;
     }
 
+    /// <summary>
+    /// Appends the encoded image to the container (std::vector, std::string, etc.), it grows as needed.
+    /// </summary>
+    /// <returns>The number of bytes that are appended.</returns>
+    template<typename Container>
+    size_t encode(Container& destination)
+    {
+        append_stream_buffer<Container> stream_buffer{destination};
+        const ByteStreamInfo destination_info{&stream_buffer, nullptr, 0};
+        const ByteStreamInfo source_info{nullptr, static_cast<uint8_t*>(const_cast<void*>(source_)), source_size_bytes_};
+        const JlsParameters parameters{get_parameters()};
+
+        const size_t old_size = destination.size();
+        size_t bytes_written;
+        const std::error_code error = charls_jpegls_encoder_encode_stream(encoder_.get(), destination_info, bytes_written,
+                                                                          source_info, parameters);
+        if (error)
+        {
+            destination.resize(old_size);
+            throw jpegls_error(error);
+        }
+
+        return bytes_written;
+    }
+
     size_t encode(void* destination, const size_t destination_size_bytes)
     {
         std::error_code error;
@@ -63,23 +128,66 @@ class jpegls_encoder final
     size_t encode(void* destination, const size_t destination_size_bytes, std::error_code& error) noexcept
     {
         size_t bytes_written;
-        JlsParameters parameters
-        {
-            metadata_.width,
-            metadata_.height,
-            metadata_.bits_per_sample,
-            0,
-            metadata_.component_count,
-            allowed_lossy_error_,
-            interleave_mode_
-        };
-
-        error = JpegLsEncode(destination, destination_size_bytes, &bytes_written,
-                             source_, source_size_bytes_, &parameters, nullptr);
+        const JlsParameters parameters{get_parameters()};
+        error = charls_jpegls_encoder_encode(encoder_.get(), destination, destination_size_bytes, &bytes_written,
+                                             source_, source_size_bytes_, &parameters);
         return bytes_written;
     }
 
 private:
+    // Stream buffer without a put area: every write of the encoder is appended to the container.
+    template<typename Container>
+    class append_stream_buffer final : public std::basic_streambuf<char>
+    {
+    public:
+        explicit append_stream_buffer(Container& container) noexcept :
+            container_{container}
+        {
+        }
+
+    protected:
+        std::streamsize xsputn(const char* s, std::streamsize count) override
+        {
+            const auto first = reinterpret_cast<const typename Container::value_type*>(s);
+            container_.insert(container_.end(), first, first + count);
+            return count;
+        }
+
+        int_type overflow(int_type ch) override
+        {
+            if (traits_type::eq_int_type(ch, traits_type::eof()))
+                return traits_type::not_eof(ch);
+
+            container_.push_back(static_cast<typename Container::value_type>(traits_type::to_char_type(ch)));
+            return ch;
+        }
+
+    private:
+        Container& container_;
+    };
+
+    JlsParameters get_parameters() const noexcept
+    {
+        JlsParameters parameters{};
+        parameters.width = metadata_.width;
+        parameters.height = metadata_.height;
+        parameters.bitsPerSample = metadata_.bits_per_sample;
+        parameters.components = metadata_.component_count;
+        parameters.allowedLossyError = allowed_lossy_error_;
+        parameters.interleaveMode = interleave_mode_;
+
+        return parameters;
+    }
+
+    struct encoder_deleter
+    {
+        void operator()(const charls_jpegls_encoder* encoder) const noexcept
+        {
+            charls_jpegls_encoder_destroy(encoder);
+        }
+    };
+
+    std::unique_ptr<charls_jpegls_encoder, encoder_deleter> encoder_;
     InterleaveMode interleave_mode_{InterleaveMode::None};
     int allowed_lossy_error_{};
 
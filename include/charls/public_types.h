@@ -47,6 +47,9 @@ namespace charls
         unexpected_end_of_image_marker = 21,     // This error is returned when the stream contains an unexpected EOI marker.
         invalid_jpegls_preset_parameter_type = 22, // This error is returned when the stream contains an invalid type parameter in the JPEG-LS segment.
         jpegls_preset_extended_parameter_type_not_supported = 23, // This error is returned when the stream contains an unsupported type parameter in the JPEG-LS segment.
+        restart_marker_not_found = 24,           // This error is returned when the stream doesn't contain the expected restart marker (RSTm) at the end of a restart interval.
+        unexpected_restart_marker = 25,          // This error is returned when the stream contains a restart marker (RSTm) outside the encoded data of a scan.
+        invalid_operation = 26,                  // This error is returned when a method call is invalid for the current state.
         invalid_argument_width = 100,            // The argument for the width parameter is outside the range [1, 65535].
         invalid_argument_height = 101,           // The argument for the height parameter is outside the range [1, 65535].
         invalid_argument_component_count = 102,  // The argument for the component count parameter is outside the range [1, 255].
@@ -55,6 +58,7 @@ namespace charls
         invalid_argument_destination = 105,      // The destination buffer or stream is not set.
         invalid_argument_source = 106,           // The source buffer or stream is not set.
         invalid_argument_thumbnail = 107,        // The arguments for the thumbnail and the dimensions don't match.
+        invalid_argument_restart_interval = 108, // The argument for the restart interval is outside the range [0, 65535].
         invalid_parameter_width = 200,           // This error is returned when the stream contains a width parameter defined more then once or in an incompatible way.
         invalid_parameter_height = 201,          // This error is returned when the stream contains a height parameter defined more then once in an incompatible way.
         invalid_parameter_component_count = 202, // This error is returned when the stream contains a component count parameter outside the range [1,255]
@@ -181,6 +185,9 @@ enum CharlsApiResult
     CHARLS_API_RESULT_UNEXPECTED_END_OF_IMAGE_MARKER        = 20,
     CHARLS_API_RESULT_INVALID_JPEGLS_PRESET_PARAMETER_TYPE  = 21,
     CHARLS_API_RESULT_JPEGLS_PRESET_EXTENDED_PARAMETER_TYPE_NOT_SUPPORTED = 22,
+    CHARLS_API_RESULT_RESTART_MARKER_NOT_FOUND              = 24,
+    CHARLS_API_RESULT_UNEXPECTED_RESTART_MARKER             = 25,
+    CHARLS_API_RESULT_INVALID_OPERATION                     = 26,
     CHARLS_API_RESULT_INVALID_ARGUMENT_WIDTH                = 100,
     CHARLS_API_RESULT_INVALID_ARGUMENT_HEIGHT               = 101,
     CHARLS_API_RESULT_INVALID_ARGUMENT_COMPONENT_COUNT      = 102,
@@ -189,6 +196,7 @@ enum CharlsApiResult
     CHARLS_API_RESULT_INVALID_ARGUMENT_DESTINATION          = 105,
     CHARLS_API_RESULT_INVALID_ARGUMENT_SOURCE               = 106,
     CHARLS_API_RESULT_INVALID_ARGUMENT_THUMBNAIL            = 107,
+    CHARLS_API_RESULT_INVALID_ARGUMENT_RESTART_INTERVAL     = 108,
     CHARLS_API_RESULT_INVALID_PARAMETER_WIDTH               = 200,
     CHARLS_API_RESULT_INVALID_PARAMETER_HEIGHT              = 201,
     CHARLS_API_RESULT_INVALID_PARAMETER_COMPONENT_COUNT     = 202,
@@ -0,0 +1,126 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#pragma once
+
+#include <charls/charls.h>
+#include <charls/jpegls_error.h>
+
+#include <algorithm>
+#include <cstring>
+#include <streambuf>
+
+namespace charls
+{
+
+/// <summary>
+/// Stream buffer whose put area is a buffer of the application, provided by the acquire buffer callback.
+/// A full buffer is handed back with the release buffer callback and the next buffer is acquired.
+/// The encoder writes its encoded bytes directly into the put area (see EncoderStrategy), without an intermediate buffer.
+/// </summary>
+class CallbackStreamBuffer final : public std::basic_streambuf<char>
+{
+public:
+    CallbackStreamBuffer(charls_acquire_buffer_handler acquireBuffer, charls_release_buffer_handler releaseBuffer, void* userContext) noexcept :
+        acquireBuffer_{acquireBuffer},
+        releaseBuffer_{releaseBuffer},
+        userContext_{userContext}
+    {
+    }
+
+    ~CallbackStreamBuffer()
+    {
+        Release();
+    }
+
+    CallbackStreamBuffer(const CallbackStreamBuffer&) = delete;
+    CallbackStreamBuffer(CallbackStreamBuffer&&) = delete;
+    CallbackStreamBuffer& operator=(const CallbackStreamBuffer&) = delete;
+    CallbackStreamBuffer& operator=(CallbackStreamBuffer&&) = delete;
+
+    /// <summary>
+    /// Returns the free part of the current buffer, a new buffer is acquired when the current buffer is full.
+    /// </summary>
+    uint8_t* GetBuffer(std::size_t& size)
+    {
+        if (pptr() == epptr())
+        {
+            NextBuffer();
+        }
+
+        size = static_cast<std::size_t>(epptr() - pptr());
+        return reinterpret_cast<uint8_t*>(pptr());
+    }
+
+    /// <summary>
+    /// Marks bytes that were written directly into the buffer returned by GetBuffer as used.
+    /// </summary>
+    void Commit(std::size_t size) noexcept
+    {
+        // pbump takes an int: commit large sizes in steps.
+        while (size > 0)
+        {
+            const auto step = static_cast<int>(std::min<std::size_t>(size, INT32_MAX));
+            pbump(step);
+            size -= static_cast<std::size_t>(step);
+        }
+    }
+
+    /// <summary>
+    /// Hands the last (partially filled) buffer back to the application.
+    /// </summary>
+    void Release() noexcept
+    {
+        if (!pbase())
+            return;
+
+        releaseBuffer_(userContext_, pbase(), static_cast<std::size_t>(pptr() - pbase()));
+        setp(nullptr, nullptr);
+    }
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        NextBuffer();
+        if (traits_type::eq_int_type(ch, traits_type::eof()))
+            return traits_type::not_eof(ch);
+
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+        return ch;
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize count) override
+    {
+        std::streamsize written = 0;
+        while (written < count)
+        {
+            std::size_t size;
+            uint8_t* buffer = GetBuffer(size);
+            const auto copySize = std::min(size, static_cast<std::size_t>(count - written));
+            std::memcpy(buffer, s + written, copySize);
+            Commit(copySize);
+            written += static_cast<std::streamsize>(copySize);
+        }
+
+        return written;
+    }
+
+private:
+    void NextBuffer()
+    {
+        Release();
+
+        std::size_t size = 0;
+        const auto buffer = static_cast<char*>(acquireBuffer_(userContext_, &size));
+        if (!buffer || size == 0)
+            throw jpegls_error{jpegls_errc::destination_buffer_too_small};
+
+        setp(buffer, buffer + size);
+    }
+
+    charls_acquire_buffer_handler acquireBuffer_;
+    charls_release_buffer_handler releaseBuffer_;
+    void* userContext_;
+};
+
+} // namespace charls
@@ -0,0 +1,72 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#pragma once
+
+#include <charls/public_types.h>
+
+#include "coding_parameters.h"
+#include "jls_codec_factory.h"
+
+#include <memory>
+
+namespace charls
+{
+
+/// <summary>
+/// Keeps the codec of the last scan: a next scan with the same parameters reuses it, including its quantization LUT and line buffers.
+/// The encoder and decoder handles keep a cache across images, a single encode or decode call across the scans of its components.
+/// </summary>
+template<typename Strategy>
+class CodecCache final
+{
+public:
+    Strategy& GetCodec(const CodingParameters& params, const JpegLSPresetCodingParameters& presets)
+    {
+        if (!codec_ || !IsEqual(params, params_) || !IsEqual(presets, presets_))
+        {
+            codec_ = JlsCodecFactory<Strategy>().CreateCodec(params, presets);
+            params_ = params;
+            presets_ = presets;
+        }
+
+        return *codec_;
+    }
+
+    // Destroys the kept codec, a next scan creates a new one.
+    void Clear() noexcept
+    {
+        codec_.reset();
+    }
+
+private:
+    // Compares the parameters that are used by a codec.
+    static bool IsEqual(const CodingParameters& lhs, const CodingParameters& rhs) noexcept
+    {
+        return lhs.width == rhs.width &&
+               lhs.height == rhs.height &&
+               lhs.bitsPerSample == rhs.bitsPerSample &&
+               lhs.stride == rhs.stride &&
+               lhs.components == rhs.components &&
+               lhs.allowedLossyError == rhs.allowedLossyError &&
+               lhs.interleaveMode == rhs.interleaveMode &&
+               lhs.colorTransformation == rhs.colorTransformation &&
+               lhs.outputBgr == rhs.outputBgr &&
+               lhs.threadCount == rhs.threadCount &&
+               lhs.restartInterval == rhs.restartInterval;
+    }
+
+    static bool IsEqual(const JpegLSPresetCodingParameters& lhs, const JpegLSPresetCodingParameters& rhs) noexcept
+    {
+        return lhs.MaximumSampleValue == rhs.MaximumSampleValue &&
+               lhs.Threshold1 == rhs.Threshold1 &&
+               lhs.Threshold2 == rhs.Threshold2 &&
+               lhs.Threshold3 == rhs.Threshold3 &&
+               lhs.ResetValue == rhs.ResetValue;
+    }
+
+    std::unique_ptr<Strategy> codec_;
+    CodingParameters params_;
+    JpegLSPresetCodingParameters presets_{};
+};
+
+} // namespace charls
@@ -0,0 +1,42 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#pragma once
+
+#include <charls/public_types.h>
+
+#include <cstdint>
+
+namespace charls
+{
+
+/// <summary>
+/// The parameters of an image as used inside the codec: the public JlsParameters and the options that are set on the encoder and
+/// decoder handles. These options are not part of JlsParameters: the size of that C struct is part of the ABI.
+/// </summary>
+struct CodingParameters final : JlsParameters
+{
+    CodingParameters() noexcept :
+        JlsParameters{}
+    {
+    }
+
+    explicit CodingParameters(const JlsParameters& params) noexcept :
+        JlsParameters(params)
+    {
+    }
+
+    /// <summary>
+    /// The maximum number of threads that can be used to encode or decode the component scans of a non interleaved image concurrently.
+    /// The value 0 or 1 encodes or decodes the component scans one after another on the calling thread.
+    /// </summary>
+    int32_t threadCount{};
+
+    /// <summary>
+    /// The number of lines in a restart interval (DRI segment, see ITU T.81, B.2.4.4). 0 means no restart markers.
+    /// At the end of every restart interval the encoded bits are padded to a byte boundary, a restart marker (RSTm) is
+    /// inserted and the coding state is reset: restart intervals can be encoded and decoded independently.
+    /// </summary>
+    int32_t restartInterval{};
+};
+
+} // namespace charls
@@ -0,0 +1,125 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#pragma once
+
+#include <charls/jpegls_error.h>
+
+#include "memory.h"
+
+#include <algorithm>
+#include <cstring>
+#include <streambuf>
+#include <vector>
+
+namespace charls
+{
+
+/// <summary>
+/// Write only stream buffer that receives the decoded pixels of an interleaved scan (all components, pixel interleaved) and writes
+/// only the selected components of every pixel to the destination: decoding a subset of the components of an interleaved image.
+/// The put area holds the first bytes of a pixel that is written in parts.
+/// </summary>
+class ComponentSelectionStreamBuffer final : public std::basic_streambuf<char>
+{
+public:
+    ComponentSelectionStreamBuffer(ByteStreamInfo destination, int32_t componentCount, uint32_t componentMask, std::size_t sampleSize, bool outputBgr) :
+        destination_{destination},
+        sampleSize_{sampleSize},
+        pixel_(static_cast<std::size_t>(componentCount) * sampleSize)
+    {
+        offsets_.reserve(static_cast<std::size_t>(componentCount));
+        for (int32_t component = 0; component < componentCount; ++component)
+        {
+            if ((componentMask & (1U << component)) == 0)
+                continue;
+
+            // The BGR swap is done before the pixel is written: the selection uses the component order of the image.
+            const int32_t position = outputBgr && component < 3 ? 2 - component : component;
+            offsets_.push_back(static_cast<std::size_t>(position) * sampleSize);
+        }
+
+        selectedPixel_.resize(offsets_.size() * sampleSize);
+        setp(pixel_.data(), pixel_.data() + pixel_.size());
+    }
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        if (pptr() == epptr())
+        {
+            WritePixel(pixel_.data());
+            setp(pixel_.data(), pixel_.data() + pixel_.size());
+        }
+
+        if (traits_type::eq_int_type(ch, traits_type::eof()))
+            return traits_type::not_eof(ch);
+
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+        return ch;
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize count) override
+    {
+        const auto pixelSize = static_cast<std::streamsize>(pixel_.size());
+        std::streamsize written = 0;
+
+        // Complete a pixel of which the first bytes were written before.
+        if (pptr() != pbase())
+        {
+            const std::streamsize size = std::min<std::streamsize>(epptr() - pptr(), count);
+            std::memcpy(pptr(), s, static_cast<std::size_t>(size));
+            pbump(static_cast<int>(size));
+            written = size;
+            if (pptr() != epptr())
+                return written;
+
+            WritePixel(pixel_.data());
+            setp(pixel_.data(), pixel_.data() + pixel_.size());
+        }
+
+        for (; count - written >= pixelSize; written += pixelSize)
+        {
+            WritePixel(s + written);
+        }
+
+        std::memcpy(pptr(), s + written, static_cast<std::size_t>(count - written));
+        pbump(static_cast<int>(count - written));
+        return count;
+    }
+
+private:
+    void WritePixel(const char* pixel)
+    {
+        char* selectedPixel = selectedPixel_.data();
+        for (const std::size_t offset : offsets_)
+        {
+            std::memcpy(selectedPixel, pixel + offset, sampleSize_);
+            selectedPixel += sampleSize_;
+        }
+
+        if (destination_.rawStream)
+        {
+            const auto size = static_cast<std::streamsize>(selectedPixel_.size());
+            if (destination_.rawStream->sputn(selectedPixel_.data(), size) != size)
+                throw jpegls_error{jpegls_errc::destination_buffer_too_small};
+
+            return;
+        }
+
+        if (destination_.count < selectedPixel_.size())
+            throw jpegls_error{jpegls_errc::destination_buffer_too_small};
+
+        std::memcpy(destination_.rawData, selectedPixel_.data(), selectedPixel_.size());
+        destination_.rawData += selectedPixel_.size();
+        destination_.count -= selectedPixel_.size();
+    }
+
+    ByteStreamInfo destination_;
+    std::size_t sampleSize_;
+    std::vector<char, Allocator<char>> pixel_;
+    std::vector<std::size_t, Allocator<std::size_t>> offsets_;
+    std::vector<char, Allocator<char>> selectedPixel_;
+};
+
+} // namespace charls
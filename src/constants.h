@@ -17,5 +17,7 @@ constexpr int DefaultResetValue = 64; // Default RESET value as defined in  ISO/
 constexpr int MaximumComponentCount = 255;
 constexpr int MinimumBitsPerSample = 2;
 constexpr int MaximumBitsPerSample = 16;
+constexpr int MaximumRestartInterval = 65535;
+constexpr int RestartMarkerRange = 8; // The restart markers RST0 - RST7 are used in modulo 8 order.
 
 } // namespace charls
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include "intrinsics.h"
+
 #include <cstdint>
 
 namespace charls
@@ -81,21 +83,7 @@ struct JlsContext final
 
     FORCE_INLINE int32_t GetGolomb() const noexcept
     {
-        const int32_t nTest = N;
-        const int32_t aTest = A;
-
-        if (nTest >= aTest) return 0;
-        if (nTest << 1 >= aTest) return 1;
-        if (nTest << 2 >= aTest) return 2;
-        if (nTest << 3 >= aTest) return 3;
-        if (nTest << 4 >= aTest) return 4;
-
-        int32_t k = 5;
-        for(; nTest << k < aTest; ++k)
-        {
-            ASSERT(k <= 32);
-        }
-        return k;
+        return compute_golomb_parameter(N, A);
     }
 };
 
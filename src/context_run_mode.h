@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include "intrinsics.h"
+
 #include <cstdint>
 
 namespace charls
@@ -32,14 +34,7 @@ struct CContextRunMode final
     FORCE_INLINE int32_t GetGolomb() const noexcept
     {
         const int32_t TEMP = A + (N >> 1) * nRItype_;
-        int32_t nTest = N;
-        int32_t k = 0;
-        for (; nTest < TEMP; ++k)
-        {
-            nTest <<= 1;
-            ASSERT(k <= 32);
-        }
-        return k;
+        return compute_golomb_parameter(N, TEMP);
     }
 
 
@@ -4,20 +4,25 @@
 
 #include <charls/jpegls_error.h>
 
+#include "coding_parameters.h"
 #include "util.h"
+#include "constants.h"
+#include "intrinsics.h"
 #include "process_line.h"
 #include "jpeg_marker_code.h"
+#include "fragmented_stream_buffer.h"
 
+#include <algorithm>
 #include <memory>
 #include <cassert>
 
 namespace charls {
 
 // Purpose: Implements encoding to stream of bits. In encoding mode JpegLsCodec inherits from EncoderStrategy
-class DecoderStrategy
+class DecoderStrategy : public Allocated
 {
 public:
-    explicit DecoderStrategy(const JlsParameters& params) :
+    explicit DecoderStrategy(const CodingParameters& params) :
         params_{params}
     {
     }
@@ -33,12 +38,25 @@ class DecoderStrategy
     virtual void SetPresets(const JpegLSPresetCodingParameters& presets) = 0;
     virtual void DecodeScan(std::unique_ptr<ProcessLine> outputData, const JlsRect& size, ByteStreamInfo& compressedData) = 0;
 
+    // Incremental decoding (see IncrementalDecoder): a started scan is decoded line by line, while the encoded data arrives.
+    virtual void StartScan(std::unique_ptr<ProcessLine> outputData, const JlsRect& size, ByteStreamInfo& compressedData) = 0;
+    virtual void DecodeLine(int32_t line) = 0;
+    virtual void FinishScan() = 0;
+
     void Init(ByteStreamInfo& compressedStream)
     {
         validBits_ = 0;
         readCache_ = 0;
 
-        if (compressedStream.rawStream)
+        fragments_ = dynamic_cast<FragmentedStreamBuffer*>(compressedStream.rawStream);
+        if (fragments_)
+        {
+            // Read the fragments in place, only the bytes around a fragment boundary are copied.
+            byteStream_ = nullptr;
+            scanOffset_ = fragments_->Offset();
+            MoveToOffset(scanOffset_);
+        }
+        else if (compressedStream.rawStream)
         {
             buffer_.resize(40000);
             position_ = buffer_.data();
@@ -59,6 +77,12 @@ class DecoderStrategy
 
     void AddBytesFromStream()
     {
+        if (fragments_)
+        {
+            AddBytesFromFragments();
+            return;
+        }
+
         if (!byteStream_ || byteStream_->sgetc() == std::char_traits<char>::eof())
             return;
 
@@ -81,6 +105,23 @@ class DecoderStrategy
         endPosition_ += readBytes;
     }
 
+    // Incremental decoding: the encoded data was moved (the byte at oldStart is now at newStart) and/or more data was appended.
+    void MoveSource(const uint8_t* oldStart, uint8_t* newStart, uint8_t* newEnd) noexcept
+    {
+        position_ = newStart + (position_ - oldStart);
+        endPosition_ = newEnd;
+        nextFFPosition_ = FindNextFF();
+    }
+
+    // Positions a fragmented source after the encoded data of the scan: the stream reader continues there.
+    void SeekToEndOfScan() const noexcept
+    {
+        if (fragments_)
+        {
+            fragments_->Seek(regionOffset_ + static_cast<std::size_t>(GetCurBytePos() - regionStart_));
+        }
+    }
+
     FORCE_INLINE void Skip(int32_t length) noexcept
     {
         validBits_ -= length;
@@ -110,6 +151,95 @@ class DecoderStrategy
             throw jpegls_error{jpegls_errc::too_much_encoded_data};
     }
 
+    // Skips the encoded data of the remaining lines of the scan (below a region of interest) without decoding it:
+    // positions the reader at the marker that ends the scan, the restart markers within the scan are passed.
+    void SkipToEndOfScan()
+    {
+        position_ = GetCurBytePos();
+        validBits_ = 0;
+        readCache_ = 0;
+
+        for (;;)
+        {
+            // Encoded data only contains 0xFF followed by a byte with the high bit unset (T.87, A.1).
+            while (endPosition_ - position_ >= 2)
+            {
+                if (position_[0] != JpegMarkerStartByte || position_[1] < 0x80)
+                {
+                    ++position_;
+                    continue;
+                }
+
+                // Skip the optional 0xFF fill bytes before the marker code (see T.81, B.1.1.2).
+                uint8_t* markerCode = position_ + 1;
+                while (markerCode < endPosition_ && *markerCode == JpegMarkerStartByte)
+                {
+                    ++markerCode;
+                }
+
+                if (markerCode == endPosition_)
+                    break;
+
+                if (*markerCode < static_cast<uint8_t>(JpegMarkerCode::StartOfRestartInterval0) ||
+                    *markerCode >= static_cast<uint8_t>(JpegMarkerCode::StartOfRestartInterval0) + RestartMarkerRange)
+                {
+                    nextFFPosition_ = position_;
+                    return;
+                }
+
+                position_ = markerCode + 1;
+            }
+
+            const auto remaining = endPosition_ - position_;
+            AddBytesFromStream();
+            if (endPosition_ - position_ == remaining)
+                throw jpegls_error{jpegls_errc::source_buffer_too_small};
+        }
+    }
+
+    // Skips a complete scan that is not decoded (component selection): the stream reader continues at the marker after it.
+    void SkipScan(ByteStreamInfo& compressedData)
+    {
+        const uint8_t* compressedBytes = compressedData.rawData;
+
+        Init(compressedData);
+        SkipToEndOfScan();
+        SeekToEndOfScan();
+        SkipBytes(compressedData, GetCurBytePos() - compressedBytes);
+    }
+
+    // Checks the end of the encoded data of a restart interval, reads the restart marker RSTm and restarts reading after it.
+    void ProcessRestartMarker(int32_t restartIndex)
+    {
+        EndScan();
+
+        position_ = GetCurBytePos();
+        AddBytesFromStream();
+
+        if (position_ == endPosition_)
+            throw jpegls_error{jpegls_errc::source_buffer_too_small};
+
+        if (*position_ != JpegMarkerStartByte)
+            throw jpegls_error{jpegls_errc::jpeg_marker_start_byte_not_found};
+
+        // Skip the start byte and all optional 0xFF fill bytes (see T.81, B.1.1.2).
+        do
+        {
+            ++position_;
+            if (position_ == endPosition_)
+                throw jpegls_error{jpegls_errc::source_buffer_too_small};
+        } while (*position_ == JpegMarkerStartByte);
+
+        if (*position_ != static_cast<int32_t>(JpegMarkerCode::StartOfRestartInterval0) + restartIndex)
+            throw jpegls_error{jpegls_errc::restart_marker_not_found};
+
+        ++position_;
+        validBits_ = 0;
+        readCache_ = 0;
+        nextFFPosition_ = FindNextFF();
+        MakeValid();
+    }
+
     FORCE_INLINE bool OptimizedRead() noexcept
     {
         // Easy & fast: if there is no 0xFF byte in sight, we can read without bit stuffing
@@ -127,13 +257,16 @@ class DecoderStrategy
 
     void MakeValid()
     {
-        ASSERT(static_cast<size_t>(validBits_) <=bufType_bit_count - 8);
+        ASSERT(validBits_ <= static_cast<int32_t>(bufType_bit_count) - 8); // Negative after corrupt encoded data, MakeValid then fails.
 
         if (OptimizedRead())
             return;
 
         AddBytesFromStream();
 
+        if (BulkRead())
+            return;
+
         do
         {
             if (position_ >= endPosition_)
@@ -172,10 +305,61 @@ class DecoderStrategy
         nextFFPosition_ = FindNextFF();
     }
 
+    // Fills the read cache from a window of sizeof(bufType) bytes that contains 0xFF bytes, but no marker.
+    // The stuffed bits are removed without the end of buffer and marker checks that are required for every byte.
+    FORCE_INLINE bool BulkRead() noexcept
+    {
+        // The loop reads at most sizeof(bufType) bytes, the byte after the window is needed for the marker check.
+        if (validBits_ < 0 || endPosition_ - position_ <= static_cast<std::ptrdiff_t>(sizeof(bufType)))
+            return false;
+
+        const bufType window = FromBigEndian<sizeof(bufType)>::Read(position_);
+        if (ContainsMarker(window, FromBigEndian<sizeof(bufType)>::Read(position_ + 1)))
+            return false;
+
+        int32_t shift = bufType_bit_count - 8;
+        do
+        {
+            const bufType valueNew = (window >> shift) & 0xFF;
+            readCache_ |= valueNew << (bufType_bit_count - 8 - validBits_);
+
+            // After a 0xFF byte the next byte only contains 7 bits: let its (zero) stuffed bit overlap.
+            validBits_ += 8 - static_cast<int32_t>(valueNew == JpegMarkerStartByte);
+            shift -= 8;
+        }
+        while (static_cast<size_t>(validBits_) < bufType_bit_count - 8);
+
+        position_ += (bufType_bit_count - 8 - shift) / 8;
+        nextFFPosition_ = FindNextFF();
+        return true;
+    }
+
     uint8_t* FindNextFF() const noexcept
     {
         auto positionNextFF = position_;
 
+#if defined(CHARLS_SSE2)
+        const __m128i allOnes = _mm_set1_epi8(static_cast<char>(JpegMarkerStartByte));
+        while (endPosition_ - positionNextFF >= 16)
+        {
+            const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(positionNextFF));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(values, allOnes)) != 0)
+                break;
+
+            positionNextFF += 16;
+        }
+#elif defined(CHARLS_NEON)
+        const uint8x16_t allOnes = vdupq_n_u8(JpegMarkerStartByte);
+        while (endPosition_ - positionNextFF >= 16)
+        {
+            if (vmaxvq_u8(vceqq_u8(vld1q_u8(positionNextFF), allOnes)) != 0)
+                break;
+
+            positionNextFF += 16;
+        }
+#endif
+
+        // Locate the 0xFF in the last block (or scan the complete buffer when no vector instructions are available).
         while (positionNextFF < endPosition_)
         {
             if (*positionNextFF == JpegMarkerStartByte)
@@ -220,14 +404,15 @@ class DecoderStrategy
         return result;
     }
 
-    FORCE_INLINE int32_t PeekByte()
+    FORCE_INLINE int32_t PeekBits(int32_t length)
     {
-        if (validBits_ < 8)
+        ASSERT(length > 0 && length <= 16);
+        if (validBits_ < length)
         {
             MakeValid();
         }
 
-        return static_cast<int32_t>(readCache_ >> (bufType_bit_count - 8));
+        return static_cast<int32_t>(readCache_ >> (bufType_bit_count - length));
     }
 
     FORCE_INLINE bool ReadBit()
@@ -242,22 +427,31 @@ class DecoderStrategy
         return bSet;
     }
 
+    // Returns the number of consecutive set bits at the start of the cache (limited to the valid bits).
+    FORCE_INLINE int32_t PeekOnes()
+    {
+        if (validBits_ < 32)
+        {
+            MakeValid();
+        }
+
+        const bufType inverted = ~readCache_;
+        return inverted == 0 ? validBits_ : std::min(count_leading_zeros(inverted), validBits_);
+    }
+
     FORCE_INLINE int32_t Peek0Bits()
     {
         if (validBits_ < 16)
         {
             MakeValid();
         }
-        bufType valTest = readCache_;
 
-        for (int32_t count = 0; count < 16; count++)
-        {
-            if ((valTest & (static_cast<bufType>(1) << (bufType_bit_count - 1))) != 0)
-                return count;
+        // Only the first 16 bits are tested, -1 signals that all these bits are zero.
+        const bufType valTest = readCache_ >> (bufType_bit_count - 16);
+        if (valTest == 0)
+            return -1;
 
-            valTest <<= 1;
-        }
-        return -1;
+        return count_leading_zeros(valTest) - static_cast<int32_t>(bufType_bit_count - 16);
     }
 
     FORCE_INLINE int32_t ReadHighBits()
@@ -270,10 +464,31 @@ class DecoderStrategy
         }
         Skip(15);
 
-        for (int32_t highBitsCount = 15; ; highBitsCount++)
+        return ReadLongHighBits(15);
+    }
+
+    // Reads the remaining zero bits (and the terminating set bit) of a long unary code, all valid bits are tested at once.
+    int32_t ReadLongHighBits(int32_t highBitsCount)
+    {
+        for (;;)
         {
-            if (ReadBit())
-                return highBitsCount;
+            if (validBits_ <= 0)
+            {
+                MakeValid();
+            }
+
+            // Note: bits after the valid bits are zero or already contain the next bits of the stream.
+            const int32_t count = readCache_ == 0 ? validBits_ : std::min(count_leading_zeros(readCache_), validBits_);
+            if (count < validBits_)
+            {
+                Skip(count + 1);
+                return highBitsCount + count;
+            }
+
+            // All valid bits are zero (skip at most half the cache to prevent an undefined shift).
+            const int32_t skipCount = std::min(count, static_cast<int32_t>(bufType_bit_count / 2));
+            Skip(skipCount);
+            highBitsCount += skipCount;
         }
     }
 
@@ -286,16 +501,81 @@ class DecoderStrategy
     }
 
 protected:
-    JlsParameters params_;
+    CodingParameters params_;
     std::unique_ptr<ProcessLine> processLine_;
 
 private:
     using bufType = std::size_t;
     static constexpr size_t bufType_bit_count = sizeof(bufType) * 8;
+    static constexpr bufType low_7_bits_mask = static_cast<bufType>(0x7F7F7F7F7F7F7F7FULL);
+
+    // Returns true when a byte of the window is 0xFF and the following byte (in nextWindow) has its high bit set.
+    static constexpr bool ContainsMarker(bufType window, bufType nextWindow) noexcept
+    {
+        return (FFBytesHighBit(window) & nextWindow) != 0;
+    }
+
+    // Returns a value with the high bit set for every byte of the value that is 0xFF (exact, no false positives).
+    static constexpr bufType FFBytesHighBit(bufType value) noexcept
+    {
+        return ~((((~value) & low_7_bits_mask) + low_7_bits_mask) | ~value) & ~low_7_bits_mask;
+    }
+
+    // Continues reading close to the end of the current fragment (or of the copied bytes around a fragment boundary).
+    void AddBytesFromFragments()
+    {
+        if (endPosition_ - position_ > static_cast<std::ptrdiff_t>(minimum_region_byte_count) ||
+            regionOffset_ + static_cast<std::size_t>(endPosition_ - regionStart_) == fragments_->Size())
+            return;
+
+        MoveToOffset(regionOffset_ + static_cast<std::size_t>(position_ - regionStart_));
+        nextFFPosition_ = FindNextFF();
+    }
+
+    // Sets the region that is read to the fragment that contains the offset, when enough bytes are available before and after it.
+    // Otherwise the bytes around the offset are copied from the fragments into buffer_. The bytes before the offset that belong
+    // to the scan are always available: GetCurBytePos looks back to the bytes in the read cache.
+    void MoveToOffset(std::size_t offset)
+    {
+        const std::size_t scanByteCount = offset - scanOffset_;
+        const std::size_t lookBackCount = scanByteCount < look_back_byte_count ? scanByteCount : look_back_byte_count;
+        if (offset < fragments_->Size())
+        {
+            std::size_t fragmentOffset;
+            std::size_t fragmentSize;
+            uint8_t* fragment = fragments_->GetFragment(offset, fragmentOffset, fragmentSize);
+            if (offset - fragmentOffset >= lookBackCount && fragmentOffset + fragmentSize - offset > minimum_region_byte_count)
+            {
+                regionStart_ = fragment;
+                regionOffset_ = fragmentOffset;
+                position_ = fragment + (offset - fragmentOffset);
+                endPosition_ = fragment + fragmentSize;
+                return;
+            }
+        }
 
-    std::vector<uint8_t> buffer_;
+        buffer_.resize(fragment_boundary_buffer_size);
+        const std::size_t copied = fragments_->Copy(offset - lookBackCount, buffer_.data(), buffer_.size());
+        regionStart_ = buffer_.data();
+        regionOffset_ = offset - lookBackCount;
+        position_ = regionStart_ + lookBackCount;
+        endPosition_ = regionStart_ + copied;
+    }
+
+    // The read cache holds at most 10 bytes (7 bits are used of a byte after 0xFF).
+    static constexpr std::size_t look_back_byte_count = 16;
+    static constexpr std::size_t minimum_region_byte_count = 64;
+    static constexpr std::size_t fragment_boundary_buffer_size = 1024;
+
+    std::vector<uint8_t, Allocator<uint8_t>> buffer_;
     std::basic_streambuf<char>* byteStream_{};
 
+    // fragmented source: the region that is read (a fragment or buffer_) starts at regionOffset_ in the complete stream.
+    FragmentedStreamBuffer* fragments_{};
+    uint8_t* regionStart_{};
+    std::size_t regionOffset_{};
+    std::size_t scanOffset_{};
+
     // decoding
     bufType readCache_{};
     int32_t validBits_{};
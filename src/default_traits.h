@@ -3,6 +3,7 @@
 #pragma once
 
 #include "util.h"
+#include "intrinsics.h"
 #include "constants.h"
 
 #include <algorithm>
@@ -4,15 +4,16 @@
 
 #include "process_line.h"
 #include "decoder_strategy.h"
+#include "callback_stream_buffer.h"
 
 namespace charls
 {
 
 // Purpose: Implements encoding to stream of bits. In encoding mode JpegLsCodec inherits from EncoderStrategy
-class EncoderStrategy
+class EncoderStrategy : public Allocated
 {
 public:
-    explicit EncoderStrategy(const JlsParameters& params) :
+    explicit EncoderStrategy(const CodingParameters& params) :
         params_(params),
         bitBuffer_(0),
         freeBitCount_(sizeof(bitBuffer_) * 8),
@@ -20,7 +21,9 @@ class EncoderStrategy
         position_(nullptr),
         isFFWritten_(false),
         bytesWritten_(0),
-        compressedStream_(nullptr)
+        compressedStream_(nullptr),
+        sink_(nullptr),
+        sinkPosition_(nullptr)
     {
     }
 
@@ -35,6 +38,11 @@ class EncoderStrategy
     virtual void SetPresets(const JpegLSPresetCodingParameters& presets) = 0;
     virtual std::size_t EncodeScan(std::unique_ptr<ProcessLine> rawData, ByteStreamInfo& compressedData) = 0;
 
+    // Incremental encoding (see IncrementalEncoder): the lines of a started scan are encoded when the application provides them.
+    virtual void StartEncodeScan(ByteStreamInfo& compressedData) = 0;
+    virtual void EncodeLines(std::unique_ptr<ProcessLine> rawData, int32_t firstLine, int32_t lineCount) = 0;
+    virtual std::size_t FinishEncodeScan() = 0;
+
     int32_t PeekByte();
 
     void OnLineBegin(int32_t cpixel, void* ptypeBuffer, int32_t pixelStride) const
@@ -52,8 +60,18 @@ class EncoderStrategy
     {
         freeBitCount_ = sizeof(bitBuffer_) * 8;
         bitBuffer_ = 0;
+        isFFWritten_ = false;
+        bytesWritten_ = 0;
 
-        if (compressedStream.rawStream)
+        compressedStream_ = nullptr;
+        sink_ = dynamic_cast<CallbackStreamBuffer*>(compressedStream.rawStream);
+        if (sink_)
+        {
+            // Write directly into the buffers of the application.
+            position_ = sink_->GetBuffer(compressedLength_);
+            sinkPosition_ = position_;
+        }
+        else if (compressedStream.rawStream)
         {
             compressedStream_ = compressedStream.rawStream;
             buffer_.resize(4000);
@@ -67,59 +85,75 @@ class EncoderStrategy
         }
     }
 
-    void AppendToBitStream(int32_t bits, int32_t bitCount)
+    // Appends up to 32 bits to the bit stream. Codes are accumulated in a 64-bit buffer (most significant bit first)
+    // that is only flushed when the new bits don't fit anymore, this allows a complete Golomb code to be written with 1 call.
+    FORCE_INLINE void AppendToBitStream(uint32_t bits, int32_t bitCount)
     {
-        ASSERT(bitCount < 32 && bitCount >= 0);
-        ASSERT((!decoder_) || (bitCount == 0 && bits == 0) ||( decoder_->ReadLongValue(bitCount) == bits));
+        ASSERT(bitCount <= 32 && bitCount >= 0);
+        ASSERT((!decoder_) || (bitCount == 0 && bits == 0) || (static_cast<uint32_t>(decoder_->ReadLongValue(bitCount)) == bits));
 #ifndef NDEBUG
-        const int mask = (1u << (bitCount)) - 1;
+        const uint32_t mask = bitCount == 32 ? 0xFFFFFFFF : (1U << bitCount) - 1;
         ASSERT((bits | mask) == mask); // Not used bits must be set to zero.
 #endif
 
-        freeBitCount_ -= bitCount;
-        if (freeBitCount_ >= 0)
+        if (bitCount > freeBitCount_)
         {
-            bitBuffer_ |= bits << freeBitCount_;
-        }
-        else
-        {
-            // Add as much bits in the remaining space as possible and flush.
-            bitBuffer_ |= bits >> -freeBitCount_;
             Flush();
+        }
 
-            // A second flush may be required if extra marker detect bits were needed and not all bits could be written.
-            if (freeBitCount_ < 0)
-            {
-                bitBuffer_ |= bits >> -freeBitCount_;
-                Flush();
-            }
+        freeBitCount_ -= bitCount;
 
-            ASSERT(freeBitCount_ >= 0);
-            bitBuffer_ |= bits << freeBitCount_;
-        }
+        // Note: freeBitCount_ can only be 64 when bitCount == 0 (and bits == 0), masking prevents an undefined shift.
+        bitBuffer_ |= static_cast<uint64_t>(bits) << (freeBitCount_ & 63);
     }
 
     void EndScan()
     {
         Flush();
 
-        // if a 0xff was written, Flush() will force one unset bit anyway
-        if (isFFWritten_)
-            AppendToBitStream(0, (freeBitCount_ - 1) % 8);
-        else
-            AppendToBitStream(0, freeBitCount_ % 8);
+        // Write the remaining bits, padded with zero bits. When the last written byte was a 0xFF,
+        // a byte with the mandatory unset bit is required to prevent that the stream ends with 0xFF.
+        if (freeBitCount_ < static_cast<int32_t>(bit_buffer_bit_count) || isFFWritten_)
+        {
+            if (compressedLength_ == 0)
+            {
+                OverFlow();
+            }
+            WriteByte();
+        }
 
-        Flush();
-        ASSERT(freeBitCount_ == 0x20);
+        ASSERT(!isFFWritten_);
+        bitBuffer_ = 0;
+        freeBitCount_ = bit_buffer_bit_count;
 
         if (compressedStream_)
         {
             OverFlow();
         }
+        else if (sink_)
+        {
+            CommitToSink();
+        }
+    }
+
+    // Ends the encoded data of a restart interval (padded like the end of a scan) and writes the restart marker RSTm.
+    void ProcessRestartMarker(int32_t restartIndex)
+    {
+        EndScan();
+        WriteMarkerByte(JpegMarkerStartByte);
+        WriteMarkerByte(static_cast<uint8_t>(static_cast<int32_t>(JpegMarkerCode::StartOfRestartInterval0) + restartIndex));
     }
 
     void OverFlow()
     {
+        if (sink_)
+        {
+            CommitToSink();
+            position_ = sink_->GetBuffer(compressedLength_);
+            sinkPosition_ = position_;
+            return;
+        }
+
         if (!compressedStream_)
             throw jpegls_error{jpegls_errc::destination_buffer_too_small};
 
@@ -133,56 +167,122 @@ class EncoderStrategy
         compressedLength_ = buffer_.size();
     }
 
+    // Writes all complete bytes of the bit buffer to the destination.
     void Flush()
     {
-        if (compressedLength_ < 4)
+        if (compressedLength_ < max_flush_byte_count)
         {
-            OverFlow();
+            // Near the end of the destination buffer: check the remaining space for every byte.
+            while (HasCompleteByte())
+            {
+                if (compressedLength_ == 0)
+                {
+                    OverFlow();
+                }
+                WriteByte();
+            }
+            return;
         }
 
-        for (int i = 0; i < 4; ++i)
+        // Fast path: write 4 bytes at once as long as no 0xFF byte (that requires a stuffed bit in the next byte) is present.
+        while (freeBitCount_ <= 32 && !isFFWritten_)
         {
-            if (freeBitCount_ >= 32)
+            const auto word = static_cast<uint32_t>(bitBuffer_ >> 32);
+            if (HasFFByte(word))
                 break;
 
-            if (isFFWritten_)
-            {
-                // JPEG-LS requirement (T.87, A.1) to detect markers: after a xFF value a single 0 bit needs to be inserted.
-                *position_ = static_cast<uint8_t>(bitBuffer_ >> 25);
-                bitBuffer_ = bitBuffer_ << 7;
-                freeBitCount_ += 7;
-            }
-            else
-            {
-                *position_ = static_cast<uint8_t>(bitBuffer_ >> 24);
-                bitBuffer_ = bitBuffer_ << 8;
-                freeBitCount_ += 8;
-            }
+            position_[0] = static_cast<uint8_t>(word >> 24);
+            position_[1] = static_cast<uint8_t>(word >> 16);
+            position_[2] = static_cast<uint8_t>(word >> 8);
+            position_[3] = static_cast<uint8_t>(word);
+            position_ += 4;
+            compressedLength_ -= 4;
+            bytesWritten_ += 4;
+            bitBuffer_ <<= 32;
+            freeBitCount_ += 32;
+        }
 
-            isFFWritten_ = *position_ == JpegMarkerStartByte;
-            position_++;
-            compressedLength_--;
-            bytesWritten_++;
+        while (HasCompleteByte())
+        {
+            WriteByte();
         }
     }
 
     std::size_t GetLength() const noexcept
     {
-        return bytesWritten_ - (freeBitCount_ - 32) / 8;
+        return bytesWritten_ - (freeBitCount_ - static_cast<int32_t>(bit_buffer_bit_count)) / 8;
     }
 
     FORCE_INLINE void AppendOnesToBitStream(int32_t length)
     {
-        AppendToBitStream((1 << length) - 1, length);
+        AppendToBitStream((1U << length) - 1, length);
     }
 
     std::unique_ptr<DecoderStrategy> decoder_;
 
-    JlsParameters params_;
+    CodingParameters params_;
     std::unique_ptr<ProcessLine> processLine_;
 
 private:
-    unsigned int bitBuffer_;
+    static constexpr std::size_t bit_buffer_bit_count = 64;
+
+    // A flush writes at most 64 bits, as 7 bits are written in bytes following a 0xFF this is at most 10 bytes.
+    static constexpr std::size_t max_flush_byte_count = bit_buffer_bit_count / 7 + 1;
+
+    static constexpr bool HasFFByte(uint32_t value) noexcept
+    {
+        // A byte of the inverted value is zero if the original byte was 0xFF.
+        return ((~value - 0x01010101U) & value & 0x80808080U) != 0;
+    }
+
+    bool HasCompleteByte() const noexcept
+    {
+        return freeBitCount_ <= (isFFWritten_ ? 57 : 56);
+    }
+
+    void WriteByte() noexcept
+    {
+        if (isFFWritten_)
+        {
+            // JPEG-LS requirement (T.87, A.1) to detect markers: after a xFF value a single 0 bit needs to be inserted.
+            *position_ = static_cast<uint8_t>(bitBuffer_ >> 57);
+            bitBuffer_ <<= 7;
+            freeBitCount_ += 7;
+        }
+        else
+        {
+            *position_ = static_cast<uint8_t>(bitBuffer_ >> 56);
+            bitBuffer_ <<= 8;
+            freeBitCount_ += 8;
+        }
+
+        isFFWritten_ = *position_ == JpegMarkerStartByte;
+        position_++;
+        compressedLength_--;
+        bytesWritten_++;
+    }
+
+    void CommitToSink() noexcept
+    {
+        sink_->Commit(static_cast<std::size_t>(position_ - sinkPosition_));
+        sinkPosition_ = position_;
+    }
+
+    // Writes a byte of a marker: marker bytes are written without bit stuffing.
+    void WriteMarkerByte(uint8_t value)
+    {
+        if (compressedLength_ == 0)
+        {
+            OverFlow();
+        }
+
+        *position_ = value;
+        position_++;
+        compressedLength_--;
+        bytesWritten_++;
+    }
+
+    uint64_t bitBuffer_;
     int32_t freeBitCount_;
     std::size_t compressedLength_;
 
@@ -191,8 +291,10 @@ class EncoderStrategy
     bool isFFWritten_;
     std::size_t bytesWritten_;
 
-    std::vector<uint8_t> buffer_;
+    std::vector<uint8_t, Allocator<uint8_t>> buffer_;
     std::basic_streambuf<char>* compressedStream_;
+    CallbackStreamBuffer* sink_;
+    uint8_t* sinkPosition_; // Start of the bytes written into the sink buffer that are not yet committed.
 };
 
 } // namespace charls
@@ -0,0 +1,162 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#pragma once
+
+#include <charls/charls.h>
+
+#include "memory.h"
+
+#include <algorithm>
+#include <cstring>
+#include <streambuf>
+#include <vector>
+
+namespace charls
+{
+
+/// <summary>
+/// Read only stream buffer over a list of fragments that together form one JPEG-LS stream (DICOM encapsulated pixel data).
+/// The get area is the current fragment: the stream reader reads the fragments in place.
+/// The decoder (see DecoderStrategy) reads the encoded data directly from the fragments, using offsets in the complete stream.
+/// </summary>
+class FragmentedStreamBuffer final : public std::basic_streambuf<char>
+{
+public:
+    FragmentedStreamBuffer(const charls_buffer_fragment* fragments, std::size_t fragmentCount)
+    {
+        fragments_.reserve(fragmentCount);
+        for (std::size_t i = 0; i < fragmentCount; ++i)
+        {
+            if (fragments[i].size_bytes == 0)
+                continue;
+
+            const auto data = static_cast<uint8_t*>(const_cast<void*>(fragments[i].data));
+            fragments_.push_back({data, fragments[i].size_bytes, size_});
+            size_ += fragments[i].size_bytes;
+        }
+
+        if (!fragments_.empty())
+        {
+            SetFragment(0);
+        }
+    }
+
+    /// <summary>
+    /// Returns the size of the complete stream.
+    /// </summary>
+    std::size_t Size() const noexcept
+    {
+        return size_;
+    }
+
+    /// <summary>
+    /// Returns the offset in the complete stream of the next byte that will be read.
+    /// </summary>
+    std::size_t Offset() const noexcept
+    {
+        if (fragments_.empty())
+            return 0;
+
+        return fragments_[current_].offset + static_cast<std::size_t>(gptr() - eback());
+    }
+
+    /// <summary>
+    /// Continues reading at an offset in the complete stream, the decoder uses it to continue after the encoded data of a scan.
+    /// </summary>
+    void Seek(std::size_t offset) noexcept
+    {
+        if (offset >= size_)
+        {
+            if (!fragments_.empty())
+            {
+                SetFragment(fragments_.size() - 1);
+                Advance(static_cast<std::size_t>(egptr() - gptr()));
+            }
+            return;
+        }
+
+        SetFragment(FindFragment(offset));
+        Advance(offset - fragments_[current_].offset);
+    }
+
+    /// <summary>
+    /// Returns the contiguous bytes of the fragment that contains the offset.
+    /// </summary>
+    /// <param name="offset">Offset in the complete stream, less than Size().</param>
+    /// <param name="fragmentOffset">Will hold the offset of the first byte of the fragment in the complete stream.</param>
+    /// <param name="fragmentSize">Will hold the size of the fragment.</param>
+    uint8_t* GetFragment(std::size_t offset, std::size_t& fragmentOffset, std::size_t& fragmentSize) const noexcept
+    {
+        const Fragment& fragment = fragments_[FindFragment(offset)];
+        fragmentOffset = fragment.offset;
+        fragmentSize = fragment.size;
+        return fragment.data;
+    }
+
+    /// <summary>
+    /// Copies bytes of the complete stream (that can span fragments) and returns the number of copied bytes.
+    /// </summary>
+    std::size_t Copy(std::size_t offset, uint8_t* destination, std::size_t count) const noexcept
+    {
+        std::size_t copied = 0;
+        for (std::size_t index = offset < size_ ? FindFragment(offset) : fragments_.size(); index < fragments_.size() && copied < count; ++index)
+        {
+            const Fragment& fragment = fragments_[index];
+            const std::size_t start = offset + copied - fragment.offset;
+            const std::size_t size = std::min(fragment.size - start, count - copied);
+            std::memcpy(destination + copied, fragment.data + start, size);
+            copied += size;
+        }
+
+        return copied;
+    }
+
+protected:
+    int_type underflow() override
+    {
+        if (fragments_.empty() || current_ + 1 == fragments_.size())
+            return traits_type::eof();
+
+        SetFragment(current_ + 1);
+        return traits_type::to_int_type(*gptr());
+    }
+
+private:
+    struct Fragment
+    {
+        uint8_t* data;
+        std::size_t size;
+        std::size_t offset;
+    };
+
+    std::size_t FindFragment(std::size_t offset) const noexcept
+    {
+        const auto it = std::upper_bound(fragments_.begin(), fragments_.end(), offset,
+                                         [](std::size_t value, const Fragment& fragment) { return value < fragment.offset; });
+        return static_cast<std::size_t>(it - fragments_.begin()) - 1;
+    }
+
+    void SetFragment(std::size_t index) noexcept
+    {
+        current_ = index;
+        const auto data = reinterpret_cast<char*>(fragments_[index].data);
+        setg(data, data, data + fragments_[index].size);
+    }
+
+    void Advance(std::size_t count) noexcept
+    {
+        // gbump takes an int: advance large counts in steps.
+        while (count > 0)
+        {
+            const auto step = static_cast<int>(std::min<std::size_t>(count, INT32_MAX));
+            gbump(step);
+            count -= static_cast<std::size_t>(step);
+        }
+    }
+
+    std::vector<Fragment, Allocator<Fragment>> fragments_;
+    std::size_t size_{};
+    std::size_t current_{};
+};
+
+} // namespace charls
@@ -0,0 +1,226 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#include "incremental_decoder.h"
+
+#include "jpeg_stream_reader.h"
+#include "util.h"
+
+#include <algorithm>
+
+using namespace charls;
+
+namespace
+{
+
+// Bytes that are kept before the read position of a scan: GetCurBytePos looks back to the bytes in the read cache.
+constexpr std::size_t LookBackByteCount = 16;
+
+// Margin for a restart marker (with fill bytes) before a line and the bytes that end a scan.
+constexpr std::size_t MarkerByteCount = 16;
+
+// Consumed bytes are removed from the buffer when they are more than half of it and at least this size.
+constexpr std::size_t MinimumCompactByteCount = 64 * 1024;
+
+} // namespace
+
+
+void IncrementalDecoder::Append(const void* data, std::size_t size)
+{
+    if (error_)
+        std::rethrow_exception(error_);
+
+    if (finished_)
+        throw jpegls_error{jpegls_errc::invalid_operation};
+
+    const uint8_t* oldStart = buffer_.data();
+    const std::size_t consumed = GetReadOffset();
+    std::size_t removed = 0;
+    if (consumed >= MinimumCompactByteCount && consumed > buffer_.size() / 2)
+    {
+        removed = consumed;
+        buffer_.erase(buffer_.begin(), buffer_.begin() + static_cast<std::ptrdiff_t>(removed));
+        readOffset_ -= std::min(readOffset_, removed);
+    }
+
+    const auto bytes = static_cast<const uint8_t*>(data);
+    buffer_.insert(buffer_.end(), bytes, bytes + size);
+
+    if (codec_)
+    {
+        codec_->MoveSource(oldStart + removed, buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+    Decode();
+}
+
+
+void IncrementalDecoder::Finish()
+{
+    if (error_)
+        std::rethrow_exception(error_);
+
+    finished_ = true;
+    Decode();
+
+    if (state_ != State::Complete)
+        throw jpegls_error{state_ == State::Destination ? jpegls_errc::invalid_operation : jpegls_errc::source_buffer_too_small};
+}
+
+
+const JlsParameters& IncrementalDecoder::GetParameters() const
+{
+    if (state_ == State::Header)
+        throw jpegls_error{jpegls_errc::source_buffer_too_small};
+
+    return params_;
+}
+
+
+void IncrementalDecoder::SetDestination(ByteStreamInfo destination)
+{
+    if (state_ != State::Destination)
+        throw jpegls_error{jpegls_errc::invalid_operation};
+
+    JpegStreamReader reader{{}};
+    reader.SetInfo(params_);
+    reader.CheckDestination(destination);
+    destination_ = destination;
+    state_ = State::ScanStart;
+
+    try
+    {
+        Decode();
+    }
+    catch (...)
+    {
+        error_ = std::current_exception();
+        throw;
+    }
+}
+
+
+void IncrementalDecoder::Decode()
+{
+    try
+    {
+        for (;;)
+        {
+            switch (state_)
+            {
+            case State::Header:
+            case State::ScanHeader:
+                if (!TryReadHeader(state_ == State::Header))
+                    return;
+                break;
+
+            case State::Destination:
+            case State::Complete:
+                return;
+
+            case State::ScanStart:
+            {
+                if (!finished_ && buffer_.size() - readOffset_ < lineByteCount_)
+                    return;
+
+                ByteStreamInfo destination{destination_};
+                SkipBytes(destination, static_cast<std::size_t>(scanIndex_) * params_.width * params_.height * ((params_.bitsPerSample + 7) / 8));
+                ByteStreamInfo source = FromByteArray(buffer_.data() + readOffset_, buffer_.size() - readOffset_);
+
+                codec_ = &codecCache_.GetCodec(params_, params_.custom);
+                codec_->StartScan(codec_->CreateProcess(destination), {0, 0, params_.width, params_.height}, source);
+                line_ = 0;
+                state_ = State::Lines;
+                break;
+            }
+
+            case State::Lines:
+                // A line is only decoded when all its encoded bytes are surely available: the decoding never has to be undone.
+                while (line_ < params_.height)
+                {
+                    if (!finished_ && GetAvailableByteCount() < lineByteCount_)
+                        return;
+
+                    codec_->DecodeLine(line_);
+                    ++line_;
+                }
+                state_ = State::ScanEnd;
+                break;
+
+            case State::ScanEnd:
+                if (!finished_ && GetAvailableByteCount() < MarkerByteCount)
+                    return;
+
+                if (GetAvailableByteCount() == 0)
+                    throw jpegls_error{jpegls_errc::source_buffer_too_small};
+
+                codec_->FinishScan();
+                readOffset_ = static_cast<std::size_t>(codec_->GetCurBytePos() - buffer_.data());
+                codec_ = nullptr;
+                ++scanIndex_;
+                line_ = 0;
+                state_ = scanIndex_ == (params_.interleaveMode == InterleaveMode::None ? params_.components : 1) ? State::Complete : State::ScanHeader;
+                break;
+            }
+        }
+    }
+    catch (...)
+    {
+        error_ = std::current_exception();
+        throw;
+    }
+}
+
+
+// Reads the header (up to and including the first SOS segment) or the SOS segment of the next scan, when it has been received completely.
+bool IncrementalDecoder::TryReadHeader(bool firstScan)
+{
+    JpegStreamReader reader{FromByteArray(buffer_.data() + readOffset_, buffer_.size() - readOffset_)};
+    try
+    {
+        if (firstScan)
+        {
+            reader.ReadHeader();
+        }
+        else
+        {
+            reader.SetInfo(params_);
+        }
+        reader.ReadStartOfScan(firstScan);
+    }
+    catch (const jpegls_error& error)
+    {
+        if (error.code() == jpegls_errc::source_buffer_too_small && !finished_)
+            return false;
+
+        throw;
+    }
+
+    readOffset_ = buffer_.size() - reader.GetRemainingSource().count;
+    params_ = reader.GetMetadata();
+    params_.threadCount = 1; // Lines are only reported as decoded when they are written to the destination.
+
+    // A sample is coded with at most LIMIT bits (ISO/IEC 14495-1, A.2.1) and a byte holds at least 7 bits of encoded data.
+    const int32_t components = params_.interleaveMode == InterleaveMode::None ? 1 : params_.components;
+    const std::size_t limit = 2 * (params_.bitsPerSample + std::max(8, params_.bitsPerSample));
+    lineByteCount_ = (static_cast<std::size_t>(params_.width) * components * limit + 6) / 7 + MarkerByteCount;
+
+    state_ = firstScan ? State::Destination : State::ScanStart;
+    return true;
+}
+
+
+std::size_t IncrementalDecoder::GetAvailableByteCount() const noexcept
+{
+    return static_cast<std::size_t>(buffer_.data() + buffer_.size() - codec_->GetCurBytePos());
+}
+
+
+// Returns the offset of the first byte that is still needed.
+std::size_t IncrementalDecoder::GetReadOffset() const noexcept
+{
+    if (!codec_)
+        return readOffset_;
+
+    const auto offset = static_cast<std::size_t>(codec_->GetCurBytePos() - buffer_.data());
+    return offset > LookBackByteCount ? offset - LookBackByteCount : 0;
+}
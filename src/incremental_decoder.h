@@ -0,0 +1,87 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#pragma once
+
+#include <charls/public_types.h>
+
+#include "codec_cache.h"
+#include "decoder_strategy.h"
+
+#include <exception>
+#include <vector>
+
+namespace charls
+{
+
+/// <summary>
+/// Decodes a JPEG-LS stream while it arrives: received bytes are appended and every line that can be decoded is written to the destination.
+/// Decoding stops before a line when its encoded data may be incomplete (less than the worst case size of a line is available) and
+/// resumes there when more bytes are appended: the bit position, contexts, run indexes and line buffers stay in the codec between calls.
+/// </summary>
+class IncrementalDecoder final
+{
+public:
+    /// <summary>
+    /// Appends received bytes and decodes as far as possible.
+    /// </summary>
+    void Append(const void* data, std::size_t size);
+
+    /// <summary>
+    /// Signals that all bytes are appended and decodes the remaining lines, an incomplete image is reported as an error.
+    /// </summary>
+    void Finish();
+
+    /// <summary>
+    /// Returns the parameters of the image, available when the header up to the first scan has been received.
+    /// </summary>
+    const JlsParameters& GetParameters() const;
+
+    /// <summary>
+    /// Sets the destination for the decoded pixels, decoding of the scans starts when it is set.
+    /// </summary>
+    void SetDestination(ByteStreamInfo destination);
+
+    int32_t GetCompletedScanCount() const noexcept
+    {
+        return scanIndex_;
+    }
+
+    int32_t GetDecodedLineCount() const noexcept
+    {
+        return line_;
+    }
+
+private:
+    enum class State
+    {
+        Header,
+        Destination,
+        ScanHeader,
+        ScanStart,
+        Lines,
+        ScanEnd,
+        Complete
+    };
+
+    void Decode();
+    bool TryReadHeader(bool firstScan);
+    std::size_t GetAvailableByteCount() const noexcept;
+    std::size_t GetReadOffset() const noexcept;
+
+    std::vector<uint8_t> buffer_;
+    std::size_t readOffset_{}; // The first byte that is not read, when no scan is being decoded.
+    bool finished_{};
+    std::exception_ptr error_;
+
+    State state_{State::Header};
+    CodingParameters params_;
+    ByteStreamInfo destination_{};
+    std::size_t lineByteCount_{};
+    int32_t scanIndex_{};
+    int32_t line_{};
+
+    CodecCache<DecoderStrategy> codecCache_;
+    DecoderStrategy* codec_{};
+};
+
+} // namespace charls
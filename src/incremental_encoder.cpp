@@ -0,0 +1,100 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#include "incremental_encoder.h"
+
+#include "util.h"
+
+using namespace charls;
+
+
+void IncrementalEncoder::Begin(const CodingParameters& params, charls_acquire_buffer_handler acquireBuffer, charls_release_buffer_handler releaseBuffer, void* userContext)
+{
+    if (codec_)
+        throw jpegls_error{jpegls_errc::invalid_operation};
+
+    // The components of a non interleaved image are encoded in separate scans: that would require to buffer the complete image.
+    if (params.interleaveMode == InterleaveMode::None && params.components > 1)
+        throw jpegls_error{jpegls_errc::invalid_argument_interleave_mode};
+
+    params_ = params;
+    params_.threadCount = 1; // A pushed line is encoded before the call returns, its source is not used afterwards.
+    if (params_.stride == 0)
+    {
+        params_.stride = params_.width * params_.components * ((params_.bitsPerSample + 7) / 8);
+    }
+
+    try
+    {
+        streamBuffer_ = std::make_unique<CallbackStreamBuffer>(acquireBuffer, releaseBuffer, userContext);
+        writer_ = JpegStreamWriter{{streamBuffer_.get(), nullptr, 0}};
+        writer_.WriteHeader(params_);
+        writer_.WriteStartOfScanSegment(params_.components, params_.allowedLossyError, params_.interleaveMode);
+
+        codec_ = &codecCache_.GetCodec(params_, params_.custom);
+        ByteStreamInfo destination{writer_.OutputStream()};
+        codec_->StartEncodeScan(destination);
+        line_ = 0;
+    }
+    catch (...)
+    {
+        Reset();
+        throw;
+    }
+}
+
+
+void IncrementalEncoder::PushLines(const void* source, std::size_t size, int32_t lineCount)
+{
+    if (!codec_)
+        throw jpegls_error{jpegls_errc::invalid_operation};
+
+    if (lineCount < 0 || lineCount > params_.height - line_)
+        throw jpegls_error{jpegls_errc::invalid_argument};
+
+    if (lineCount == 0)
+        return;
+
+    const std::size_t lineSize = static_cast<std::size_t>(params_.width) * params_.components * ((params_.bitsPerSample + 7) / 8);
+    if (size < static_cast<std::size_t>(lineCount - 1) * params_.stride + lineSize)
+        throw jpegls_error{jpegls_errc::source_buffer_too_small};
+
+    try
+    {
+        codec_->EncodeLines(codec_->CreateProcess(FromByteArrayConst(source, size)), line_, lineCount);
+        line_ += lineCount;
+    }
+    catch (...)
+    {
+        Reset();
+        throw;
+    }
+}
+
+
+std::size_t IncrementalEncoder::Finish()
+{
+    if (!codec_ || line_ != params_.height)
+        throw jpegls_error{jpegls_errc::invalid_operation};
+
+    try
+    {
+        writer_.Seek(codec_->FinishEncodeScan());
+        writer_.WriteEndOfImage();
+        const std::size_t bytesWritten = writer_.GetBytesWritten();
+        Reset();
+        return bytesWritten;
+    }
+    catch (...)
+    {
+        Reset();
+        throw;
+    }
+}
+
+
+// Ends the current image: the last buffer is handed back to the application.
+void IncrementalEncoder::Reset() noexcept
+{
+    codec_ = nullptr;
+    streamBuffer_.reset();
+}
@@ -0,0 +1,57 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#pragma once
+
+#include <charls/public_types.h>
+
+#include "callback_stream_buffer.h"
+#include "codec_cache.h"
+#include "encoder_strategy.h"
+#include "jpeg_stream_writer.h"
+
+#include <memory>
+
+namespace charls
+{
+
+/// <summary>
+/// Encodes an image whose lines are provided over time (push model): every pushed line is encoded immediately and the encoded bytes
+/// are written into the buffers of the application (acquire/release callbacks), no complete frame is buffered.
+/// The bit writer, contexts, run indexes and line buffers stay in the codec between calls.
+/// </summary>
+class IncrementalEncoder final
+{
+public:
+    /// <summary>
+    /// Starts the encoding of an image: writes the header and the first SOS segment.
+    /// </summary>
+    void Begin(const CodingParameters& params, charls_acquire_buffer_handler acquireBuffer, charls_release_buffer_handler releaseBuffer, void* userContext);
+
+    /// <summary>
+    /// Encodes the next lines of the image, the source holds lineCount lines of params.stride bytes.
+    /// </summary>
+    void PushLines(const void* source, std::size_t size, int32_t lineCount);
+
+    /// <summary>
+    /// Ends the image after all lines are pushed, releases the last buffer and returns the size of the encoded image.
+    /// </summary>
+    std::size_t Finish();
+
+    int32_t GetEncodedLineCount() const noexcept
+    {
+        return line_;
+    }
+
+private:
+    void Reset() noexcept;
+
+    CodingParameters params_;
+    std::unique_ptr<CallbackStreamBuffer> streamBuffer_;
+    JpegStreamWriter writer_;
+    int32_t line_{};
+
+    CodecCache<EncoderStrategy> codecCache_;
+    EncoderStrategy* codec_{};
+};
+
+} // namespace charls
@@ -5,20 +5,34 @@
 
 #include "jpeg_stream_reader.h"
 #include "jpeg_stream_writer.h"
-#include "jpegls_preset_coding_parameters.h"
 #include "encoder_strategy.h"
 #include "jls_codec_factory.h"
 #include "util.h"
 #include "constants.h"
+#include "parallel.h"
+#include "codec_cache.h"
+#include "callback_stream_buffer.h"
+#include "fragmented_stream_buffer.h"
+#include "incremental_decoder.h"
+#include "incremental_encoder.h"
+#include "memory.h"
+
+#include <limits>
+#include <new>
+#include <sstream>
+#include <string>
 
 using namespace charls;
 
 namespace {
 
-void VerifyInput(const ByteStreamInfo& destination, const JlsParameters& parameters)
+void VerifyParameters(const JlsParameters& parameters)
 {
-    if (!destination.rawStream && !destination.rawData)
-        throw jpegls_error{jpegls_errc::invalid_argument_destination};
+    if (parameters.width < 1 || parameters.width > 65535)
+        throw jpegls_error{jpegls_errc::invalid_argument_width};
+
+    if (parameters.height < 1 || parameters.height > 65535)
+        throw jpegls_error{jpegls_errc::invalid_argument_height};
 
     if (parameters.bitsPerSample < MinimumBitsPerSample || parameters.bitsPerSample > MaximumBitsPerSample)
         throw jpegls_error{jpegls_errc::invalid_argument_bits_per_sample};
@@ -29,10 +43,6 @@ void VerifyInput(const ByteStreamInfo& destination, const JlsParameters& paramet
     if (parameters.components < 1 || parameters.components > MaximumComponentCount)
         throw jpegls_error{jpegls_errc::invalid_argument_component_count};
 
-    if (destination.rawData &&
-        destination.count < static_cast<size_t>(parameters.height) * parameters.width * parameters.components * (parameters.bitsPerSample > 8 ? 2 : 1))
-        throw jpegls_error{jpegls_errc::destination_buffer_too_small};
-
     switch (parameters.components)
     {
     case 3:
@@ -46,6 +56,19 @@ void VerifyInput(const ByteStreamInfo& destination, const JlsParameters& paramet
 }
 
 
+void VerifyInput(const ByteStreamInfo& source, const JlsParameters& parameters)
+{
+    VerifyParameters(parameters);
+
+    if (!source.rawStream && !source.rawData)
+        throw jpegls_error{jpegls_errc::invalid_argument_source};
+
+    if (source.rawData &&
+        source.count < static_cast<size_t>(parameters.height) * parameters.width * parameters.components * (parameters.bitsPerSample > 8 ? 2 : 1))
+        throw jpegls_error{jpegls_errc::source_buffer_too_small};
+}
+
+
 jpegls_errc to_jpegls_errc() noexcept
 {
     try
@@ -67,94 +90,288 @@ jpegls_errc to_jpegls_errc() noexcept
     }
 }
 
-void EncodeScan(const JlsParameters& params, int componentCount, ByteStreamInfo source, JpegStreamWriter& writer)
+void EncodeScan(const CodingParameters& params, int componentCount, ByteStreamInfo source, JpegStreamWriter& writer, CodecCache<EncoderStrategy>& codecCache)
 {
-    JlsParameters info{params};
+    CodingParameters info{params};
     info.components = componentCount;
 
-    auto codec = JlsCodecFactory<EncoderStrategy>().CreateCodec(info, info.custom);
-    std::unique_ptr<ProcessLine> processLine(codec->CreateProcess(source));
+    EncoderStrategy& codec = codecCache.GetCodec(info, info.custom);
+    std::unique_ptr<ProcessLine> processLine(codec.CreateProcess(source));
     ByteStreamInfo destination{writer.OutputStream()};
-    const size_t bytesWritten = codec->EncodeScan(move(processLine), destination);
+    const size_t bytesWritten = codec.EncodeScan(move(processLine), destination);
 
     // Synchronize the destination encapsulated in the writer (EncodeScan works on a local copy)
     writer.Seek(bytesWritten);
 }
 
-} // namespace
+// Encodes a scan into a separate buffer, allows to encode scans concurrently.
+std::string EncodeScan(const CodingParameters& params, int componentCount, ByteStreamInfo source)
+{
+    CodingParameters info{params};
+    info.components = componentCount;
+
+    auto codec = JlsCodecFactory<EncoderStrategy>().CreateCodec(info, info.custom);
+    std::unique_ptr<ProcessLine> processLine(codec->CreateProcess(source));
+    std::stringbuf buffer;
+    ByteStreamInfo destination{&buffer, nullptr, 0};
+    codec->EncodeScan(move(processLine), destination);
 
+    return buffer.str();
+}
 
-jpegls_errc JpegLsEncodeStream(ByteStreamInfo destination, size_t& bytesWritten,
-                               ByteStreamInfo source, const JlsParameters& params)
+
+// Encodes all scans concurrently: the scans of non interleaved components and the restart intervals of a scan are independent.
+// Every restart interval is encoded as a separate scan into its own buffer, the buffers are written in order separated by restart markers.
+void EncodeScansParallel(const CodingParameters& params, ByteStreamInfo source, JpegStreamWriter& writer)
 {
-    if (params.width < 1 || params.width > 65535)
-        return jpegls_errc::invalid_argument_width;
+    const size_t byteCountComponent = static_cast<size_t>(params.width) * params.height * ((params.bitsPerSample + 7) / 8);
+    const int32_t scanCount = params.interleaveMode == InterleaveMode::None ? params.components : 1;
+    const int32_t scanComponentCount = params.interleaveMode == InterleaveMode::None ? 1 : params.components;
+    const int32_t intervalHeight = params.restartInterval > 0 ? std::min(params.restartInterval, params.height) : params.height;
+    const int32_t intervalCount = (params.height + intervalHeight - 1) / intervalHeight;
+
+    std::vector<std::string> intervals(static_cast<size_t>(scanCount) * intervalCount);
+    ParallelFor(static_cast<int32_t>(intervals.size()), params.threadCount, [&](int32_t index)
+    {
+        const int32_t scan = index / intervalCount;
+        const int32_t interval = index % intervalCount;
 
-    if (params.height < 1 || params.height > 65535)
-        return jpegls_errc::invalid_argument_height;
+        CodingParameters intervalParams{params};
+        intervalParams.height = std::min(intervalHeight, params.height - interval * intervalHeight);
+        intervalParams.restartInterval = 0;
+        intervalParams.threadCount = 1; // The intervals themselves are encoded concurrently.
 
-    try
-    {
-        VerifyInput(source, params);
+        ByteStreamInfo intervalSource{source};
+        SkipBytes(intervalSource, byteCountComponent * scan + static_cast<size_t>(params.stride) * interval * intervalHeight);
+        intervals[index] = EncodeScan(intervalParams, scanComponentCount, intervalSource);
+    });
 
-        JlsParameters info{params};
-        if (info.stride == 0)
+    for (int32_t scan = 0; scan < scanCount; ++scan)
+    {
+        writer.WriteStartOfScanSegment(scanComponentCount, params.allowedLossyError, params.interleaveMode);
+        for (int32_t interval = 0; interval < intervalCount; ++interval)
         {
-            info.stride = info.width * ((info.bitsPerSample + 7) / 8);
-            if (info.interleaveMode != InterleaveMode::None)
+            if (interval > 0)
             {
-                info.stride *= info.components;
+                writer.WriteRestartMarker((interval - 1) % RestartMarkerRange);
             }
+
+            const std::string& data = intervals[static_cast<size_t>(scan) * intervalCount + interval];
+            writer.WriteScanData(data.data(), data.size());
         }
+    }
+}
 
-        JpegStreamWriter writer{destination};
 
-        writer.WriteStartOfImage();
+void EncodeStream(ByteStreamInfo destination, size_t& bytesWritten, ByteStreamInfo source, const CodingParameters& params, CodecCache<EncoderStrategy>& codecCache)
+{
+    VerifyInput(source, params);
 
-        if (info.jfif.version != 0)
+    CodingParameters info{params};
+    if (info.stride == 0)
+    {
+        info.stride = info.width * ((info.bitsPerSample + 7) / 8);
+        if (info.interleaveMode != InterleaveMode::None)
         {
-            writer.WriteJpegFileInterchangeFormatSegment(info.jfif);
+            info.stride *= info.components;
         }
+    }
 
-        writer.WriteStartOfFrameSegment(info.width, info.height, info.bitsPerSample, info.components);
+    JpegStreamWriter writer{destination};
+    writer.WriteHeader(info);
 
-        if (info.colorTransformation != ColorTransformation::None)
+    const bool independentScans = (info.interleaveMode == InterleaveMode::None && info.components > 1) ||
+                                  (info.restartInterval > 0 && info.restartInterval < info.height);
+    if (independentScans && info.threadCount > 1 && source.rawData)
+    {
+        EncodeScansParallel(info, source, writer);
+    }
+    else if (info.interleaveMode == InterleaveMode::None)
+    {
+        const int32_t byteCountComponent = info.width * info.height * ((info.bitsPerSample + 7) / 8);
+        for (int32_t component = 0; component < info.components; ++component)
         {
-            writer.WriteColorTransformSegment(info.colorTransformation);
-        }
+            writer.WriteStartOfScanSegment(1, info.allowedLossyError, info.interleaveMode);
+            EncodeScan(info, 1, source, writer, codecCache);
 
-        if (!IsDefault(info.custom))
-        {
-            writer.WriteJpegLSPresetParametersSegment(info.custom);
-        }
-        else if (info.bitsPerSample > 12)
-        {
-            const JpegLSPresetCodingParameters preset = ComputeDefault((1 << info.bitsPerSample) - 1, info.allowedLossyError);
-            writer.WriteJpegLSPresetParametersSegment(preset);
+            // Synchronize the source stream (EncodeScan works on a local copy)
+            SkipBytes(source, byteCountComponent);
         }
+    }
+    else
+    {
+        writer.WriteStartOfScanSegment(info.components, info.allowedLossyError, info.interleaveMode);
+        EncodeScan(info, info.components, source, writer, codecCache);
+    }
 
-        if (info.interleaveMode == InterleaveMode::None)
-        {
-            const int32_t byteCountComponent = info.width * info.height * ((info.bitsPerSample + 7) / 8);
-            for (int32_t component = 0; component < info.components; ++component)
-            {
-                writer.WriteStartOfScanSegment(1, info.allowedLossyError, info.interleaveMode);
-                EncodeScan(info, 1, source, writer);
+    writer.WriteEndOfImage();
 
-                // Synchronize the source stream (EncodeScan works on a local copy)
-                SkipBytes(source, byteCountComponent);
-            }
-        }
-        else
+    bytesWritten = writer.GetBytesWritten();
+}
+
+
+// Validates the parameters that determine the size of an image (the parameters of an encoded image, as returned by read header).
+void VerifyFrameParameters(const JlsParameters& params)
+{
+    if (params.width < 1 || params.width > 65535)
+        throw jpegls_error{jpegls_errc::invalid_argument_width};
+
+    if (params.height < 1 || params.height > 65535)
+        throw jpegls_error{jpegls_errc::invalid_argument_height};
+
+    if (params.bitsPerSample < MinimumBitsPerSample || params.bitsPerSample > MaximumBitsPerSample)
+        throw jpegls_error{jpegls_errc::invalid_argument_bits_per_sample};
+
+    if (params.components < 1 || params.components > MaximumComponentCount)
+        throw jpegls_error{jpegls_errc::invalid_argument_component_count};
+}
+
+
+// Returns an upper bound of the size of an encoded image: a sample is coded with at most LIMIT bits (ISO/IEC 14495-1, A.2.1 and A.7.2),
+// a byte holds at least 7 bits of encoded data (a bit is stuffed after a 0xFF byte) and every marker segment the encoder can write is included.
+// The restart interval is set on the encoder: the size includes the restart markers of the shortest restart interval (1 line).
+uint64_t EstimatedDestinationSize(const JlsParameters& params)
+{
+    VerifyFrameParameters(params);
+
+    const uint64_t limit = 2 * (params.bitsPerSample + std::max(8, params.bitsPerSample));
+    const uint64_t scanCount = params.interleaveMode == InterleaveMode::None ? params.components : 1;
+    const uint64_t intervalCount = static_cast<uint64_t>(params.height);
+    const uint64_t scanComponentCount = params.interleaveMode == InterleaveMode::None ? 1 : params.components;
+
+    const uint64_t encodedBits = static_cast<uint64_t>(params.width) * params.height * params.components * limit;
+    uint64_t size = (encodedBits + 6) / 7;
+    size += scanCount * intervalCount * 2;                         // padding byte and the byte after a final 0xFF byte of every interval.
+    size += scanCount * (intervalCount - 1) * 2;                   // RSTm markers
+    size += scanCount * (8 + 2 * scanComponentCount);              // SOS segments
+    size += 2 + 10 + 3 * static_cast<uint64_t>(params.components); // SOI, SOF segment
+    size += 9 + 15 + 6 + 2;                                        // color transformation, LSE and DRI segments, EOI
+    if (params.jfif.version != 0)
+    {
+        size += 18 + 3 * static_cast<uint64_t>(params.jfif.Xthumbnail) * params.jfif.Ythumbnail;
+    }
+
+    return size;
+}
+
+
+void DecodeStream(ByteStreamInfo destination, ByteStreamInfo source, const CodingParameters& params, const JlsRect* rect, CodecCache<DecoderStrategy>& codecCache,
+                  uint32_t componentMask = 0)
+{
+    JpegStreamReader reader{source};
+    reader.SetCodecCache(&codecCache);
+    reader.SetComponentMask(componentMask);
+    reader.SetInfo(params);
+
+    if (rect)
+    {
+        reader.SetRect(*rect);
+    }
+
+    reader.Read(destination);
+}
+
+
+// An encode or decode call of a handle: with a scratch buffer set, all memory of the call is allocated from it.
+// The codec is then not kept for the next call, the buffer is reused.
+template<typename Strategy>
+class HandleCall final
+{
+public:
+    HandleCall(ScratchArena& scratch, CodecCache<Strategy>& codecCache, int32_t threadCount, int32_t restartInterval = 0) noexcept :
+        scope_{scratch},
+        scratch_{scratch},
+        codecCache_{codecCache},
+        threadCount_{threadCount},
+        restartInterval_{restartInterval}
+    {
+    }
+
+    ~HandleCall()
+    {
+        if (scratch_.HasBuffer())
         {
-            writer.WriteStartOfScanSegment(info.components, info.allowedLossyError, info.interleaveMode);
-            EncodeScan(info, info.components, source, writer);
+            codecCache_.Clear();
+            scratch_.Reset();
         }
+    }
 
-        writer.WriteEndOfImage();
+    HandleCall(const HandleCall&) = delete;
+    HandleCall(HandleCall&&) = delete;
+    HandleCall& operator=(const HandleCall&) = delete;
+    HandleCall& operator=(HandleCall&&) = delete;
+
+    // A scratch buffer serves the calling thread only: the image is coded without worker threads.
+    int32_t ThreadCount() const noexcept
+    {
+        return scratch_.HasBuffer() ? 1 : threadCount_;
+    }
+
+    CodingParameters Parameters(const JlsParameters& params) const noexcept
+    {
+        CodingParameters info{params};
+        info.threadCount = ThreadCount();
+        info.restartInterval = restartInterval_;
+        return info;
+    }
+
+private:
+    ScratchScope scope_;
+    ScratchArena& scratch_;
+    CodecCache<Strategy>& codecCache_;
+    int32_t threadCount_;
+    int32_t restartInterval_;
+};
+
+} // namespace
 
-        bytesWritten = writer.GetBytesWritten();
 
+// The encoder and decoder handles of the C API: the codec of the last scan is kept for the next image.
+struct charls_jpegls_encoder final
+{
+    CodecCache<EncoderStrategy> codecCache;
+    ScratchArena scratch; // The buffer of the application that the calls allocate from, instead of the heap.
+    int32_t threadCount{};
+    int32_t restartInterval{};
+};
+
+
+struct charls_jpegls_decoder final
+{
+    CodecCache<DecoderStrategy> codecCache;
+    ScratchArena scratch;
+    int32_t threadCount{};
+    JpegStreamReader headerReader{{}}; // Reader positioned after the first SOS segment by read_header.
+    bool headerRead{};
+};
+
+
+jpegls_errc JpegLsEncodeStream(ByteStreamInfo destination, size_t& bytesWritten,
+                               ByteStreamInfo source, const JlsParameters& params)
+{
+    try
+    {
+        CodecCache<EncoderStrategy> codecCache;
+        EncodeStream(destination, bytesWritten, source, CodingParameters{params}, codecCache);
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+jpegls_errc charls_jpegls_encoder_encode_stream(charls_jpegls_encoder* encoder, ByteStreamInfo destination, size_t& bytesWritten,
+                                               ByteStreamInfo source, const JlsParameters& params)
+{
+    if (!encoder)
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        const HandleCall<EncoderStrategy> call{encoder->scratch, encoder->codecCache, encoder->threadCount, encoder->restartInterval};
+        EncodeStream(destination, bytesWritten, source, call.Parameters(params), encoder->codecCache);
         return jpegls_errc::success;
     }
     catch (...)
@@ -168,15 +385,26 @@ jpegls_errc JpegLsDecodeStream(ByteStreamInfo destination, ByteStreamInfo source
 {
     try
     {
-        JpegStreamReader reader{source};
+        CodecCache<DecoderStrategy> codecCache;
+        DecodeStream(destination, source, CodingParameters{params ? *params : JlsParameters{}}, nullptr, codecCache);
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
 
-        if (params)
-        {
-            reader.SetInfo(*params);
-        }
 
-        reader.Read(destination);
+jpegls_errc charls_jpegls_decoder_decode_stream(charls_jpegls_decoder* decoder, ByteStreamInfo destination, ByteStreamInfo source, const JlsParameters* params)
+{
+    if (!decoder)
+        return jpegls_errc::invalid_argument;
 
+    try
+    {
+        const HandleCall<DecoderStrategy> call{decoder->scratch, decoder->codecCache, decoder->threadCount};
+        DecodeStream(destination, source, call.Parameters(params ? *params : JlsParameters{}), nullptr, decoder->codecCache);
         return jpegls_errc::success;
     }
     catch (...)
@@ -193,7 +421,7 @@ jpegls_errc JpegLsReadHeaderStream(ByteStreamInfo source, JlsParameters* params)
         JpegStreamReader reader{source};
         reader.ReadHeader();
         reader.ReadStartOfScan(true);
-        *params = reader.GetMetadata();
+        *params = static_cast<const JlsParameters&>(reader.GetMetadata()); // Only the public part: the struct of the caller has this size.
 
         return jpegls_errc::success;
     }
@@ -241,18 +469,467 @@ JpegLsDecodeRect(void* destination, size_t destinationLength, const void* source
 {
     try
     {
-        const ByteStreamInfo sourceInfo{FromByteArrayConst(source, sourceLength)};
-        JpegStreamReader reader{sourceInfo};
-        const ByteStreamInfo destinationInfo{FromByteArray(destination, destinationLength)};
+        CodecCache<DecoderStrategy> codecCache;
+        DecodeStream(FromByteArray(destination, destinationLength), FromByteArrayConst(source, sourceLength), CodingParameters{params ? *params : JlsParameters{}},
+                     &roi, codecCache);
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+charls_jpegls_encoder* CHARLS_API_CALLING_CONVENTION
+charls_jpegls_encoder_create()
+{
+    return new (std::nothrow) charls_jpegls_encoder;
+}
+
+
+void CHARLS_API_CALLING_CONVENTION
+charls_jpegls_encoder_destroy(const charls_jpegls_encoder* encoder)
+{
+    delete encoder;
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_encoder_encode(charls_jpegls_encoder* encoder, void* destination, size_t destination_size_bytes, size_t* bytes_written,
+                             const void* source, size_t source_size_bytes, const JlsParameters* params)
+{
+    if (!encoder || !destination || !bytes_written || !source || !params)
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        const HandleCall<EncoderStrategy> call{encoder->scratch, encoder->codecCache, encoder->threadCount, encoder->restartInterval};
+        EncodeStream(FromByteArray(destination, destination_size_bytes), *bytes_written, FromByteArrayConst(source, source_size_bytes),
+                     call.Parameters(*params), encoder->codecCache);
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_encoder_encode_to_callback(charls_jpegls_encoder* encoder, charls_acquire_buffer_handler acquire_buffer,
+                                         charls_release_buffer_handler release_buffer, void* user_context, size_t* bytes_written,
+                                         const void* source, size_t source_size_bytes, const JlsParameters* params)
+{
+    if (!encoder || !acquire_buffer || !release_buffer || !bytes_written || !source || !params)
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        const HandleCall<EncoderStrategy> call{encoder->scratch, encoder->codecCache, encoder->threadCount, encoder->restartInterval};
+        CallbackStreamBuffer streamBuffer{acquire_buffer, release_buffer, user_context};
+        EncodeStream({&streamBuffer, nullptr, 0}, *bytes_written, FromByteArrayConst(source, source_size_bytes), call.Parameters(*params), encoder->codecCache);
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_encoder_get_estimated_destination_size(const JlsParameters* params, size_t* size_in_bytes)
+{
+    if (!params || !size_in_bytes)
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        const uint64_t size = EstimatedDestinationSize(*params);
+        if (size > std::numeric_limits<size_t>::max())
+            return jpegls_errc::not_enough_memory;
+
+        *size_in_bytes = static_cast<size_t>(size);
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_encoder_set_scratch_buffer(charls_jpegls_encoder* encoder, void* buffer, size_t buffer_size_bytes)
+{
+    if (!encoder || (!buffer && buffer_size_bytes != 0))
+        return jpegls_errc::invalid_argument;
+
+    encoder->codecCache.Clear();
+    encoder->scratch.SetBuffer(buffer, buffer_size_bytes);
+    return jpegls_errc::success;
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_encoder_set_thread_count(charls_jpegls_encoder* encoder, int32_t thread_count)
+{
+    if (!encoder || thread_count < 0)
+        return jpegls_errc::invalid_argument;
+
+    encoder->threadCount = thread_count;
+    return jpegls_errc::success;
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_encoder_set_restart_interval(charls_jpegls_encoder* encoder, int32_t restart_interval)
+{
+    if (!encoder)
+        return jpegls_errc::invalid_argument;
+
+    if (restart_interval < 0 || restart_interval > MaximumRestartInterval)
+        return jpegls_errc::invalid_argument_restart_interval;
+
+    encoder->restartInterval = restart_interval;
+    return jpegls_errc::success;
+}
+
+
+charls_jpegls_decoder* CHARLS_API_CALLING_CONVENTION
+charls_jpegls_decoder_create()
+{
+    return new (std::nothrow) charls_jpegls_decoder;
+}
+
+
+void CHARLS_API_CALLING_CONVENTION
+charls_jpegls_decoder_destroy(const charls_jpegls_decoder* decoder)
+{
+    delete decoder;
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_decoder_decode(charls_jpegls_decoder* decoder, void* destination, size_t destination_size_bytes,
+                             const void* source, size_t source_size_bytes, const JlsParameters* params)
+{
+    if (!decoder)
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        const HandleCall<DecoderStrategy> call{decoder->scratch, decoder->codecCache, decoder->threadCount};
+        DecodeStream(FromByteArray(destination, destination_size_bytes), FromByteArrayConst(source, source_size_bytes),
+                     call.Parameters(params ? *params : JlsParameters{}), nullptr, decoder->codecCache);
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
 
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_decoder_decode_region(charls_jpegls_decoder* decoder, void* destination, size_t destination_size_bytes,
+                                    const void* source, size_t source_size_bytes, const JlsRect* region, uint32_t component_mask, const JlsParameters* params)
+{
+    if (!decoder)
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        const HandleCall<DecoderStrategy> call{decoder->scratch, decoder->codecCache, decoder->threadCount};
+        DecodeStream(FromByteArray(destination, destination_size_bytes), FromByteArrayConst(source, source_size_bytes),
+                     call.Parameters(params ? *params : JlsParameters{}), region, decoder->codecCache, component_mask);
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_decoder_decode_fragments(charls_jpegls_decoder* decoder, void* destination, size_t destination_size_bytes,
+                                       const charls_buffer_fragment* fragments, size_t fragment_count, const JlsParameters* params)
+{
+    if (!decoder || !destination || (!fragments && fragment_count != 0))
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        const HandleCall<DecoderStrategy> call{decoder->scratch, decoder->codecCache, decoder->threadCount};
+        FragmentedStreamBuffer source{fragments, fragment_count};
+        DecodeStream(FromByteArray(destination, destination_size_bytes), {&source, nullptr, 0}, call.Parameters(params ? *params : JlsParameters{}), nullptr,
+                     decoder->codecCache);
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_decoder_read_header(charls_jpegls_decoder* decoder, const void* source, size_t source_size_bytes, JlsParameters* params)
+{
+    if (!decoder || !params)
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        decoder->headerRead = false;
+
+        JpegStreamReader reader{FromByteArrayConst(source, source_size_bytes)};
+        reader.ReadHeader();
+        reader.ReadStartOfScan(true);
+        reader.SetCodecCache(&decoder->codecCache);
+        *params = static_cast<const JlsParameters&>(reader.GetMetadata());
+
+        decoder->headerReader = reader;
+        decoder->headerRead = true;
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_decoder_decode_to_buffer(charls_jpegls_decoder* decoder, void* destination, size_t destination_size_bytes, const JlsParameters* params)
+{
+    if (!decoder || !decoder->headerRead)
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        const HandleCall<DecoderStrategy> call{decoder->scratch, decoder->codecCache, decoder->threadCount};
+
+        // Decode from a copy of the reader: the encoded data of the header can be decoded again.
+        JpegStreamReader reader{decoder->headerReader};
+
+        CodingParameters info{reader.GetMetadata()};
         if (params)
         {
-            reader.SetInfo(*params);
+            if (params->stride != 0)
+            {
+                info.stride = params->stride;
+            }
+            info.outputBgr = params->outputBgr;
         }
+        info.threadCount = call.ThreadCount();
+        reader.SetInfo(info);
+
+        reader.ReadScans(FromByteArray(destination, destination_size_bytes));
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_decoder_set_scratch_buffer(charls_jpegls_decoder* decoder, void* buffer, size_t buffer_size_bytes)
+{
+    if (!decoder || (!buffer && buffer_size_bytes != 0))
+        return jpegls_errc::invalid_argument;
+
+    decoder->codecCache.Clear();
+    decoder->scratch.SetBuffer(buffer, buffer_size_bytes);
+    return jpegls_errc::success;
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_decoder_set_thread_count(charls_jpegls_decoder* decoder, int32_t thread_count)
+{
+    if (!decoder || thread_count < 0)
+        return jpegls_errc::invalid_argument;
+
+    decoder->threadCount = thread_count;
+    return jpegls_errc::success;
+}
+
+
+struct charls_jpegls_incremental_decoder final
+{
+    IncrementalDecoder decoder;
+};
+
+
+charls_jpegls_incremental_decoder* CHARLS_API_CALLING_CONVENTION
+charls_jpegls_incremental_decoder_create()
+{
+    return new (std::nothrow) charls_jpegls_incremental_decoder;
+}
+
+
+void CHARLS_API_CALLING_CONVENTION
+charls_jpegls_incremental_decoder_destroy(const charls_jpegls_incremental_decoder* decoder)
+{
+    delete decoder;
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_incremental_decoder_append(charls_jpegls_incremental_decoder* decoder, const void* source, size_t source_size_bytes)
+{
+    if (!decoder || (!source && source_size_bytes != 0))
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        decoder->decoder.Append(source, source_size_bytes);
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_incremental_decoder_get_parameters(const charls_jpegls_incremental_decoder* decoder, JlsParameters* params)
+{
+    if (!decoder || !params)
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        *params = decoder->decoder.GetParameters();
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_incremental_decoder_set_destination(charls_jpegls_incremental_decoder* decoder, void* destination, size_t destination_size_bytes)
+{
+    if (!decoder || !destination)
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        decoder->decoder.SetDestination(FromByteArray(destination, destination_size_bytes));
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_incremental_decoder_get_progress(const charls_jpegls_incremental_decoder* decoder, int32_t* completed_scan_count, int32_t* decoded_line_count)
+{
+    if (!decoder || !completed_scan_count || !decoded_line_count)
+        return jpegls_errc::invalid_argument;
+
+    *completed_scan_count = decoder->decoder.GetCompletedScanCount();
+    *decoded_line_count = decoder->decoder.GetDecodedLineCount();
+    return jpegls_errc::success;
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_incremental_decoder_finish(charls_jpegls_incremental_decoder* decoder)
+{
+    if (!decoder)
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        decoder->decoder.Finish();
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+struct charls_jpegls_incremental_encoder final
+{
+    IncrementalEncoder encoder;
+    int32_t restartInterval{};
+};
+
+
+charls_jpegls_incremental_encoder* CHARLS_API_CALLING_CONVENTION
+charls_jpegls_incremental_encoder_create()
+{
+    return new (std::nothrow) charls_jpegls_incremental_encoder;
+}
+
+
+void CHARLS_API_CALLING_CONVENTION
+charls_jpegls_incremental_encoder_destroy(const charls_jpegls_incremental_encoder* encoder)
+{
+    delete encoder;
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_incremental_encoder_set_restart_interval(charls_jpegls_incremental_encoder* encoder, int32_t restart_interval)
+{
+    if (!encoder)
+        return jpegls_errc::invalid_argument;
+
+    if (restart_interval < 0 || restart_interval > MaximumRestartInterval)
+        return jpegls_errc::invalid_argument_restart_interval;
+
+    encoder->restartInterval = restart_interval;
+    return jpegls_errc::success;
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_incremental_encoder_begin(charls_jpegls_incremental_encoder* encoder, const JlsParameters* params,
+                                        charls_acquire_buffer_handler acquire_buffer, charls_release_buffer_handler release_buffer, void* user_context)
+{
+    if (!encoder || !params || !acquire_buffer || !release_buffer)
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        VerifyParameters(*params);
+        CodingParameters info{*params};
+        info.restartInterval = encoder->restartInterval;
+        encoder->encoder.Begin(info, acquire_buffer, release_buffer, user_context);
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
 
-        reader.SetRect(roi);
-        reader.Read(destinationInfo);
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_incremental_encoder_push_lines(charls_jpegls_incremental_encoder* encoder, const void* source, size_t source_size_bytes, int32_t line_count)
+{
+    if (!encoder || !source)
+        return jpegls_errc::invalid_argument;
 
+    try
+    {
+        encoder->encoder.PushLines(source, source_size_bytes, line_count);
         return jpegls_errc::success;
     }
     catch (...)
@@ -261,4 +938,52 @@ JpegLsDecodeRect(void* destination, size_t destinationLength, const void* source
     }
 }
 
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_jpegls_incremental_encoder_finish(charls_jpegls_incremental_encoder* encoder, size_t* bytes_written)
+{
+    if (!encoder || !bytes_written)
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        *bytes_written = encoder->encoder.Finish();
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_get_scratch_size(const JlsParameters* params, size_t* size_in_bytes)
+{
+    if (!params || !size_in_bytes)
+        return jpegls_errc::invalid_argument;
+
+    try
+    {
+        VerifyFrameParameters(*params);
+        *size_in_bytes = GetScratchSize(*params);
+        return jpegls_errc::success;
+    }
+    catch (...)
+    {
+        return to_jpegls_errc();
+    }
+}
+
+
+jpegls_errc CHARLS_API_CALLING_CONVENTION
+charls_set_allocator(charls_allocate_handler allocate, charls_free_handler free, void* user_context)
+{
+    if (!allocate != !free)
+        return jpegls_errc::invalid_argument;
+
+    SetAllocator(allocate, free, user_context);
+    return jpegls_errc::success;
+}
+
 }
@@ -0,0 +1,135 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#pragma once
+
+#include "util.h"
+
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// BMI2 is available on every CPU that supports AVX2 (MSVC doesn't define __BMI2__ for /arch:AVX2).
+#if defined(__BMI2__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define CHARLS_BMI2
+#include <immintrin.h>
+#endif
+
+// Thin portable layer over the bit manipulation instructions of the target (lzcnt/bsr, tzcnt/bsf, bzhi).
+// Note: variable shifts are compiled to shlx/shrx automatically when BMI2 code generation is enabled.
+
+namespace charls
+{
+
+/// <summary>
+/// Returns the number of consecutive 0 bits, starting at the most significant bit. The value may not be zero.
+/// </summary>
+template<typename T>
+inline int32_t count_leading_zeros(T value) noexcept
+{
+    static_assert(std::is_unsigned<T>::value && (sizeof(T) == 4 || sizeof(T) == 8), "Only 32 and 64 bit unsigned types are supported");
+    ASSERT(value != 0);
+
+#if defined(__GNUC__) || defined(__clang__)
+    return sizeof(T) == 8 ? __builtin_clzll(static_cast<unsigned long long>(value)) : __builtin_clz(static_cast<unsigned int>(value));
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    if (sizeof(T) == 8)
+    {
+        _BitScanReverse64(&index, static_cast<unsigned __int64>(value));
+        return 63 - static_cast<int32_t>(index);
+    }
+
+    _BitScanReverse(&index, static_cast<unsigned long>(value));
+    return 31 - static_cast<int32_t>(index);
+#else
+    int32_t count = 0;
+    for (T mask = T{1} << (sizeof(T) * 8 - 1); (value & mask) == 0; mask >>= 1)
+    {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+
+/// <summary>
+/// Returns the number of consecutive 0 bits, starting at the least significant bit. The value may not be zero.
+/// </summary>
+template<typename T>
+inline int32_t count_trailing_zeros(T value) noexcept
+{
+    static_assert(std::is_unsigned<T>::value && (sizeof(T) == 4 || sizeof(T) == 8), "Only 32 and 64 bit unsigned types are supported");
+    ASSERT(value != 0);
+
+#if defined(__GNUC__) || defined(__clang__)
+    return sizeof(T) == 8 ? __builtin_ctzll(static_cast<unsigned long long>(value)) : __builtin_ctz(static_cast<unsigned int>(value));
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    if (sizeof(T) == 8)
+    {
+        _BitScanForward64(&index, static_cast<unsigned __int64>(value));
+    }
+    else
+    {
+        _BitScanForward(&index, static_cast<unsigned long>(value));
+    }
+    return static_cast<int32_t>(index);
+#else
+    int32_t count = 0;
+    for (T mask = 1; (value & mask) == 0; mask <<= 1)
+    {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+
+/// <summary>
+/// Returns the value with all bits at position count and higher set to zero (count must be less than 32).
+/// </summary>
+inline uint32_t zero_high_bits(uint32_t value, int32_t count) noexcept
+{
+    ASSERT(count >= 0 && count < 32);
+
+#ifdef CHARLS_BMI2
+    return _bzhi_u32(value, static_cast<uint32_t>(count));
+#else
+    return value & ((1U << count) - 1);
+#endif
+}
+
+
+/// <summary>
+/// Returns the smallest x for which (1 << x) >= n.
+/// </summary>
+inline int32_t log_2(int32_t n) noexcept
+{
+    if (n <= 1)
+        return 0;
+
+    return 32 - count_leading_zeros(static_cast<uint32_t>(n - 1));
+}
+
+
+/// <summary>
+/// Returns the smallest k for which (n << k) >= a, n must be greater than zero.
+/// Computes the Golomb coding parameter (ISO/IEC 14495-1, A.5.1) in constant time.
+/// </summary>
+inline int32_t compute_golomb_parameter(int32_t n, int32_t a) noexcept
+{
+    ASSERT(n > 0);
+
+    if (n >= a)
+        return 0;
+
+    // a and n << k have the same bit length, n << (k - 1) is certainly smaller than a.
+    const int32_t k = count_leading_zeros(static_cast<uint32_t>(n)) - count_leading_zeros(static_cast<uint32_t>(a));
+    return (n << k) < a ? k + 1 : k;
+}
+
+} // namespace charls
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <memory>
 
 struct JlsParameters;
@@ -10,14 +11,19 @@ struct JpegLSPresetCodingParameters;
 namespace charls
 {
 
+struct CodingParameters;
+
 template<typename Strategy>
 class JlsCodecFactory final
 {
 public:
-    std::unique_ptr<Strategy> CreateCodec(const JlsParameters& params, const JpegLSPresetCodingParameters& presets);
+    std::unique_ptr<Strategy> CreateCodec(const CodingParameters& params, const JpegLSPresetCodingParameters& presets);
 
 private:
-    std::unique_ptr<Strategy> CreateOptimizedCodec(const JlsParameters& params);
+    std::unique_ptr<Strategy> CreateOptimizedCodec(const CodingParameters& params);
 };
 
+// Returns the size of a scratch buffer (see ScratchArena) that holds all memory allocated by an encode or decode call of an image.
+std::size_t GetScratchSize(const JlsParameters& params);
+
 } // namespace charls
@@ -19,9 +19,11 @@ constexpr uint8_t JpegMarkerStartByte = 0xFF;
 
 enum class JpegMarkerCode : uint8_t
 {
-    StartOfImage = 0xD8, // SOI: Marks the start of an image.
-    EndOfImage = 0xD9,   // EOI: Marks the end of an image.
-    StartOfScan = 0xDA,  // SOS: Marks the start of scan.
+    StartOfImage = 0xD8,            // SOI:  Marks the start of an image.
+    EndOfImage = 0xD9,              // EOI:  Marks the end of an image.
+    StartOfScan = 0xDA,             // SOS:  Marks the start of scan.
+    DefineRestartInterval = 0xDD,   // DRI:  Defines the restart interval used in succeeding scans.
+    StartOfRestartInterval0 = 0xD0, // RST0: Marks the start of a restart interval, RST1 - RST7 (0xD1 - 0xD7) follow in modulo 8 order.
 
     // The following markers are defined in ISO/IEC 10918-1 | ITU T.81.
     StartOfFrameBaselineJpeg = 0xC0,            // SOF_0:  Marks the start of a baseline jpeg encoded frame.
@@ -2,20 +2,24 @@
 
 #include "jpeg_stream_reader.h"
 
+#include "codec_cache.h"
+#include "component_selection_stream_buffer.h"
 #include "constants.h"
 #include "decoder_strategy.h"
 #include "encoder_strategy.h"
 #include "jls_codec_factory.h"
 #include "jpeg_marker_code.h"
 #include "jpegls_preset_parameters_type.h"
+#include "parallel.h"
 #include "util.h"
 
 #include <algorithm>
+#include <array>
+#include <cstring>
 #include <iomanip>
 #include <memory>
 
-using std::vector;
-using std::find;
+using std::array;
 using namespace charls;
 
 namespace
@@ -39,6 +43,24 @@ void CheckParameterCoherent(const JlsParameters& params)
     }
 }
 
+
+// Returns the position of the first marker in the encoded data or end when there is none.
+// Encoded data can only contain a 0xFF byte followed by a byte with the high bit unset (T.87, A.1), a marker code byte has the high bit set.
+const uint8_t* FindMarker(const uint8_t* begin, const uint8_t* end) noexcept
+{
+    for (;;)
+    {
+        const auto position = static_cast<const uint8_t*>(memchr(begin, JpegMarkerStartByte, end - begin));
+        if (!position || position + 1 == end)
+            return end;
+
+        if (position[1] >= 0x80)
+            return position;
+
+        begin = position + 2;
+    }
+}
+
 } // namespace
 
 namespace charls
@@ -52,6 +74,21 @@ JpegStreamReader::JpegStreamReader(ByteStreamInfo byteStreamInfo) noexcept
 void JpegStreamReader::Read(ByteStreamInfo rawPixels)
 {
     ReadHeader();
+    CheckDestination(rawPixels);
+    ReadStartOfScan(true);
+    DecodeScans(rawPixels);
+}
+
+
+void JpegStreamReader::ReadScans(ByteStreamInfo rawPixels)
+{
+    CheckDestination(rawPixels);
+    DecodeScans(rawPixels);
+}
+
+
+void JpegStreamReader::CheckDestination(const ByteStreamInfo& rawPixels)
+{
     CheckParameterCoherent(params_);
 
     if (rect_.Width <= 0)
@@ -60,35 +97,203 @@ void JpegStreamReader::Read(ByteStreamInfo rawPixels)
         rect_.Height = params_.height;
     }
 
-    const int64_t bytesPerPlane = static_cast<int64_t>(rect_.Width) * rect_.Height * ((params_.bitsPerSample + 7) / 8);
+    if (params_.components < 32 && (componentMask_ >> params_.components) != 0)
+        throw jpegls_error{jpegls_errc::invalid_argument};
 
-    if (rawPixels.rawData && static_cast<int64_t>(rawPixels.count) < bytesPerPlane * params_.components)
+    if (rawPixels.rawData && static_cast<int64_t>(rawPixels.count) < BytesPerPlane() * SelectedComponentCount())
         throw jpegls_error{jpegls_errc::destination_buffer_too_small};
+}
+
+
+int64_t JpegStreamReader::BytesPerPlane() const noexcept
+{
+    return static_cast<int64_t>(rect_.Width) * rect_.Height * ((params_.bitsPerSample + 7) / 8);
+}
+
+
+bool JpegStreamReader::IsComponentSelected(int32_t component) const noexcept
+{
+    return componentMask_ == 0 || (component < 32 && (componentMask_ & (1U << component)) != 0);
+}
 
-    int componentIndex{};
 
-    while (componentIndex < params_.components)
+int32_t JpegStreamReader::SelectedComponentCount() const noexcept
+{
+    int32_t count = 0;
+    for (int32_t component = 0; component < params_.components; ++component)
     {
-        ReadStartOfScan(componentIndex == 0);
+        count += IsComponentSelected(component) ? 1 : 0;
+    }
+
+    return count;
+}
+
 
-        std::unique_ptr<DecoderStrategy> codec = JlsCodecFactory<DecoderStrategy>().CreateCodec(params_, params_.custom);
-        std::unique_ptr<ProcessLine> processLine(codec->CreateProcess(rawPixels));
-        codec->DecodeScan(move(processLine), rect_, byteStream_);
-        SkipBytes(rawPixels, static_cast<size_t>(bytesPerPlane));
+void JpegStreamReader::DecodeScans(ByteStreamInfo rawPixels)
+{
+    const int64_t bytesPerPlane = BytesPerPlane();
+
+    // The scans of non interleaved components and the restart intervals of a scan are independent:
+    // decode them concurrently when their boundaries can be located up front.
+    const bool independentScans = params_.interleaveMode == InterleaveMode::None && params_.components > 1;
+    const bool fullImage = rect_.X == 0 && rect_.Y == 0 && rect_.Width == params_.width && rect_.Height == params_.height;
+    const bool independentIntervals = fullImage && params_.restartInterval > 0 && params_.restartInterval < params_.height;
+    const bool allComponents = SelectedComponentCount() == params_.components;
+    std::vector<ScanInterval> intervals;
+    if (params_.threadCount > 1 && (independentScans || independentIntervals) && allComponents &&
+        byteStream_.rawData && rawPixels.rawData && TryFindScanIntervals(intervals, independentIntervals))
+    {
+        DecodeScanIntervals(intervals, rawPixels, bytesPerPlane);
+        return;
+    }
+
+    CodecCache<DecoderStrategy> localCodecCache;
+    CodecCache<DecoderStrategy>& codecCache = codecCache_ ? *codecCache_ : localCodecCache;
+    int componentIndex{};
 
+    for (;;)
+    {
+        DecoderStrategy& codec = codecCache.GetCodec(params_, params_.custom);
         if (params_.interleaveMode != InterleaveMode::None)
+        {
+            if (allComponents)
+            {
+                codec.DecodeScan(codec.CreateProcess(rawPixels), rect_, byteStream_);
+                return;
+            }
+
+            // The decoded pixels of all components pass through a stream buffer that writes the selected components.
+            ComponentSelectionStreamBuffer selection{rawPixels, params_.components, componentMask_,
+                                                     static_cast<size_t>((params_.bitsPerSample + 7) / 8), params_.outputBgr != 0};
+            codec.DecodeScan(codec.CreateProcess({&selection, nullptr, 0}), rect_, byteStream_);
             return;
+        }
+
+        // The scan of a component that is not selected is skipped without decoding it.
+        if (IsComponentSelected(componentIndex))
+        {
+            std::unique_ptr<ProcessLine> processLine(codec.CreateProcess(rawPixels));
+            codec.DecodeScan(move(processLine), rect_, byteStream_);
+            SkipBytes(rawPixels, static_cast<size_t>(bytesPerPlane));
+        }
+        else
+        {
+            codec.SkipScan(byteStream_);
+        }
 
         componentIndex += 1;
+        if (componentIndex == params_.components)
+            return;
+
+        ReadStartOfScan(false);
     }
 }
 
 
-void JpegStreamReader::ReadNBytes(std::vector<char>& destination, int byteCount)
+// Locates the SOS segments of all scans and optionally the restart markers within the scans by searching for the marker that follows
+// the encoded data of a scan or restart interval. Every restart interval is decoded as a separate scan (the coding state is reset).
+// When this is not possible (invalid or unexpected stream structure) the reader is restored and false is returned:
+// sequential decoding will then report the error at the same location as without a thread count.
+bool JpegStreamReader::TryFindScanIntervals(std::vector<ScanInterval>& intervals, bool splitIntervals)
+{
+    const ByteStreamInfo firstScanData{byteStream_};
+    const CodingParameters firstScanParams{params_};
+
+    const int32_t scanCount = params_.interleaveMode == InterleaveMode::None ? params_.components : 1;
+    const int32_t intervalHeight = splitIntervals ? params_.restartInterval : params_.height;
+    const int32_t intervalCount = (params_.height + intervalHeight - 1) / intervalHeight;
+
+    try
+    {
+        for (int32_t scan = 0; scan < scanCount; ++scan)
+        {
+            for (int32_t interval = 0; interval < intervalCount; ++interval)
+            {
+                if (scan > 0 || interval > 0)
+                {
+                    const uint8_t* marker = FindMarker(byteStream_.rawData, byteStream_.rawData + byteStream_.count);
+                    SkipBytes(byteStream_, static_cast<size_t>(marker - byteStream_.rawData));
+                }
+
+                if (interval > 0)
+                {
+                    if (ReadNextMarkerCode() != static_cast<JpegMarkerCode>(static_cast<int>(JpegMarkerCode::StartOfRestartInterval0) + (interval - 1) % RestartMarkerRange))
+                        throw jpegls_error{jpegls_errc::restart_marker_not_found};
+                }
+                else if (scan > 0)
+                {
+                    ReadStartOfScan(false);
+                    if (params_.interleaveMode != InterleaveMode::None)
+                        throw jpegls_error{jpegls_errc::parameter_value_not_supported};
+                }
+
+                ScanInterval scanInterval{params_, byteStream_, scan, interval * intervalHeight};
+                scanInterval.params.height = std::min(intervalHeight, params_.height - scanInterval.firstLine);
+                scanInterval.params.restartInterval = splitIntervals ? 0 : params_.restartInterval;
+                scanInterval.params.threadCount = 1; // The intervals themselves are decoded concurrently.
+                intervals.push_back(scanInterval);
+            }
+        }
+
+        return true;
+    }
+    catch (const jpegls_error&)
+    {
+    }
+
+    byteStream_ = firstScanData;
+    params_ = firstScanParams;
+    intervals.clear();
+    return false;
+}
+
+
+void JpegStreamReader::DecodeScanIntervals(const std::vector<ScanInterval>& intervals, ByteStreamInfo rawPixels, int64_t bytesPerPlane)
+{
+    const auto intervalCount = static_cast<int32_t>(intervals.size());
+
+    ParallelFor(intervalCount, params_.threadCount, [&](int32_t index)
+    {
+        const ScanInterval& interval = intervals[index];
+        ByteStreamInfo destination{rawPixels};
+        SkipBytes(destination, static_cast<size_t>(bytesPerPlane) * interval.scan + static_cast<size_t>(interval.params.stride) * interval.firstLine);
+
+        // A split interval is decoded as a complete image of its lines, otherwise the interval is the complete scan.
+        JlsRect rect{rect_};
+        if (interval.params.height != params_.height)
+        {
+            rect = {0, 0, interval.params.width, interval.params.height};
+        }
+
+        ByteStreamInfo encodedData{interval.encodedData};
+        std::unique_ptr<DecoderStrategy> codec = JlsCodecFactory<DecoderStrategy>().CreateCodec(interval.params, interval.params.custom);
+        std::unique_ptr<ProcessLine> processLine(codec->CreateProcess(destination));
+        codec->DecodeScan(move(processLine), rect, encodedData);
+
+        if (index == intervalCount - 1)
+        {
+            byteStream_ = encodedData;
+        }
+        else if (FindMarker(encodedData.rawData, encodedData.rawData + encodedData.count) != encodedData.rawData)
+        {
+            // The encoded data should be directly followed by the next marker (same errors as sequential decoding).
+            if (encodedData.count == 0)
+                throw jpegls_error{jpegls_errc::source_buffer_too_small};
+
+            if (encodedData.rawData[0] != JpegMarkerStartByte)
+                throw jpegls_error{jpegls_errc::jpeg_marker_start_byte_not_found};
+
+            throw jpegls_error{intervals[index + 1].firstLine == 0 ? jpegls_errc::invalid_encoded_data : jpegls_errc::restart_marker_not_found};
+        }
+    });
+}
+
+
+void JpegStreamReader::ReadNBytes(char* destination, int byteCount)
 {
     for (int i = 0; i < byteCount; ++i)
     {
-        destination.push_back(static_cast<char>(ReadByte()));
+        destination[i] = static_cast<char>(ReadByte());
     }
 }
 
@@ -98,6 +303,8 @@ void JpegStreamReader::ReadHeader()
     if (ReadNextMarkerCode() != JpegMarkerCode::StartOfImage)
         throw jpegls_error{jpegls_errc::start_of_image_marker_not_found};
 
+    params_.restartInterval = 0;
+
     for (;;)
     {
         const JpegMarkerCode markerCode = ReadNextMarkerCode();
@@ -146,6 +353,7 @@ void JpegStreamReader::ValidateMarkerCode(JpegMarkerCode markerCode) const
     case JpegMarkerCode::StartOfFrameJpegLS:
     case JpegMarkerCode::JpegLSPresetParameters:
     case JpegMarkerCode::StartOfScan:
+    case JpegMarkerCode::DefineRestartInterval:
     case JpegMarkerCode::Comment:
     case JpegMarkerCode::ApplicationData0:
     case JpegMarkerCode::ApplicationData1:
@@ -184,8 +392,16 @@ void JpegStreamReader::ValidateMarkerCode(JpegMarkerCode markerCode) const
 
     case JpegMarkerCode::EndOfImage:
         throw jpegls_error{jpegls_errc::unexpected_end_of_image_marker};
+
+    case JpegMarkerCode::StartOfRestartInterval0:
+        throw jpegls_error{jpegls_errc::unexpected_restart_marker};
     }
 
+    // RST1 - RST7 have no enumerator of their own.
+    if (static_cast<int>(markerCode) > static_cast<int>(JpegMarkerCode::StartOfRestartInterval0) &&
+        static_cast<int>(markerCode) < static_cast<int>(JpegMarkerCode::StartOfRestartInterval0) + RestartMarkerRange)
+        throw jpegls_error{jpegls_errc::unexpected_restart_marker};
+
     throw jpegls_error{jpegls_errc::unknown_jpeg_marker_found};
 }
 
@@ -203,6 +419,9 @@ int JpegStreamReader::ReadMarkerSegment(JpegMarkerCode markerCode, int32_t segme
     case JpegMarkerCode::JpegLSPresetParameters:
         return ReadPresetParametersSegment(segmentSize);
 
+    case JpegMarkerCode::DefineRestartInterval:
+        return ReadDefineRestartIntervalSegment(segmentSize);
+
     case JpegMarkerCode::ApplicationData0:
     case JpegMarkerCode::ApplicationData1:
     case JpegMarkerCode::ApplicationData2:
@@ -223,7 +442,7 @@ int JpegStreamReader::ReadMarkerSegment(JpegMarkerCode markerCode, int32_t segme
     case JpegMarkerCode::ApplicationData8:
         return TryReadHPColorTransformSegment(segmentSize);
 
-    // Other tags not supported (among which DNL DRI)
+    // Other tags not supported (among which DNL)
     default:
         ASSERT(false);
         return 0;
@@ -323,6 +542,24 @@ int JpegStreamReader::ReadPresetParametersSegment(int32_t segmentSize)
 }
 
 
+int JpegStreamReader::ReadDefineRestartIntervalSegment(int32_t segmentSize)
+{
+    // JPEG-LS allows a restart interval of 2, 3 or 4 bytes (the JPEG DRI segment only 2 bytes).
+    if (segmentSize < 2 || segmentSize > 4)
+        throw jpegls_error{jpegls_errc::invalid_marker_segment_size};
+
+    uint32_t restartInterval = 0;
+    for (int i = 0; i < segmentSize; ++i)
+    {
+        restartInterval = (restartInterval << 8) | ReadByte();
+    }
+
+    // Intervals larger than the maximum height have the same effect as no restart markers.
+    params_.restartInterval = static_cast<int32_t>(std::min(restartInterval, static_cast<uint32_t>(INT32_MAX)));
+    return segmentSize;
+}
+
+
 void JpegStreamReader::ReadStartOfScan(bool firstComponent)
 {
     if (!firstComponent)
@@ -385,9 +622,11 @@ void JpegStreamReader::ReadJfif()
     params_.jfif.Ythumbnail = ReadByte();
     if (params_.jfif.Xthumbnail > 0 && params_.jfif.thumbnail)
     {
-        std::vector<char> tempBuffer(static_cast<char*>(params_.jfif.thumbnail),
-                                     static_cast<char*>(params_.jfif.thumbnail) + static_cast<size_t>(3) * params_.jfif.Xthumbnail * params_.jfif.Ythumbnail);
-        ReadNBytes(tempBuffer, 3 * params_.jfif.Xthumbnail * params_.jfif.Ythumbnail);
+        // The thumbnail is not returned: skip its RGB pixels.
+        for (int i = 0; i < 3 * params_.jfif.Xthumbnail * params_.jfif.Ythumbnail; ++i)
+        {
+            SkipByte();
+        }
     }
 }
 
@@ -395,7 +634,13 @@ void JpegStreamReader::ReadJfif()
 uint8_t JpegStreamReader::ReadByte()
 {
     if (byteStream_.rawStream)
-        return static_cast<uint8_t>(byteStream_.rawStream->sbumpc());
+    {
+        const auto value = byteStream_.rawStream->sbumpc();
+        if (value == std::char_traits<char>::eof())
+            throw jpegls_error{jpegls_errc::source_buffer_too_small};
+
+        return static_cast<uint8_t>(value);
+    }
 
     if (byteStream_.count == 0)
         throw jpegls_error{jpegls_errc::source_buffer_too_small};
@@ -434,8 +679,8 @@ int JpegStreamReader::TryReadHPColorTransformSegment(int32_t segmentSize)
     if (segmentSize < 5)
         return 0;
 
-    vector<char> sourceTag;
-    ReadNBytes(sourceTag, 4);
+    array<char, 4> sourceTag;
+    ReadNBytes(sourceTag.data(), static_cast<int>(sourceTag.size()));
     if (strncmp(sourceTag.data(), "mrfx", 4) != 0)
         return 4;
 
@@ -461,10 +706,10 @@ int JpegStreamReader::TryReadHPColorTransformSegment(int32_t segmentSize)
 
 void JpegStreamReader::AddComponent(uint8_t componentId)
 {
-    if (find(componentIds_.cbegin(), componentIds_.cend(), componentId) != componentIds_.cend())
+    if (componentIds_.test(componentId))
         throw jpegls_error{jpegls_errc::duplicate_component_id_in_sof_segment};
 
-    componentIds_.push_back(componentId);
+    componentIds_.set(componentId);
 }
 
 
@@ -4,6 +4,9 @@
 
 #include <charls/public_types.h>
 
+#include "coding_parameters.h"
+
+#include <bitset>
 #include <cstdint>
 #include <vector>
 
@@ -11,6 +14,8 @@ namespace charls
 {
 
 enum class JpegMarkerCode : uint8_t;
+class DecoderStrategy;
+template<typename Strategy> class CodecCache;
 
 // Purpose: minimal implementation to read a JPEG byte stream.
 class JpegStreamReader final
@@ -18,7 +23,7 @@ class JpegStreamReader final
 public:
     explicit JpegStreamReader(ByteStreamInfo byteStreamInfo) noexcept;
 
-    const JlsParameters& GetMetadata() const noexcept
+    const CodingParameters& GetMetadata() const noexcept
     {
         return params_;
     }
@@ -31,7 +36,16 @@ class JpegStreamReader final
     void Read(ByteStreamInfo rawPixels);
     void ReadHeader();
 
-    void SetInfo(const JlsParameters& params) noexcept
+    // Decodes the scans when the header and the first SOS segment have already been read (ReadHeader, ReadStartOfScan).
+    void ReadScans(ByteStreamInfo rawPixels);
+
+    // The part of the source that has not been read yet.
+    const ByteStreamInfo& GetRemainingSource() const noexcept
+    {
+        return byteStream_;
+    }
+
+    void SetInfo(const CodingParameters& params) noexcept
     {
         params_ = params;
     }
@@ -41,14 +55,44 @@ class JpegStreamReader final
         rect_ = rect;
     }
 
+    // Selects the components that are decoded (bit i selects component i), 0 selects all components.
+    void SetComponentMask(uint32_t componentMask) noexcept
+    {
+        componentMask_ = componentMask;
+    }
+
+    // The cache of the decoder handle that keeps the codec of the last scan, without a cache the codec is kept during Read.
+    void SetCodecCache(CodecCache<DecoderStrategy>* codecCache) noexcept
+    {
+        codecCache_ = codecCache;
+    }
+
     void ReadStartOfScan(bool firstComponent);
     uint8_t ReadByte();
 
+    // Validates the parameters and checks that the destination is large enough for all selected components.
+    void CheckDestination(const ByteStreamInfo& rawPixels);
+
 private:
+    struct ScanInterval
+    {
+        CodingParameters params;
+        ByteStreamInfo encodedData;
+        int32_t scan;
+        int32_t firstLine;
+    };
+
+    int64_t BytesPerPlane() const noexcept;
+    bool IsComponentSelected(int32_t component) const noexcept;
+    int32_t SelectedComponentCount() const noexcept;
+    void DecodeScans(ByteStreamInfo rawPixels);
+    bool TryFindScanIntervals(std::vector<ScanInterval>& intervals, bool splitIntervals);
+    void DecodeScanIntervals(const std::vector<ScanInterval>& intervals, ByteStreamInfo rawPixels, int64_t bytesPerPlane);
+
     void SkipByte();
     int ReadUInt16();
     int32_t ReadSegmentSize();
-    void ReadNBytes(std::vector<char>& destination, int byteCount);
+    void ReadNBytes(char* destination, int byteCount);
     JpegMarkerCode ReadNextMarkerCode();
     void ValidateMarkerCode(JpegMarkerCode markerCode) const;
 
@@ -56,14 +100,17 @@ class JpegStreamReader final
     int ReadStartOfFrameSegment(int32_t segmentSize);
     static int ReadComment() noexcept;
     int ReadPresetParametersSegment(int32_t segmentSize);
+    int ReadDefineRestartIntervalSegment(int32_t segmentSize);
     void ReadJfif();
     int TryReadHPColorTransformSegment(int32_t segmentSize);
     void AddComponent(uint8_t componentId);
 
     ByteStreamInfo byteStream_;
-    JlsParameters params_{};
+    CodingParameters params_;
     JlsRect rect_{};
-    std::vector<uint8_t> componentIds_;
+    uint32_t componentMask_{};
+    std::bitset<256> componentIds_; // The component identifiers of the SOF segment, no heap memory is needed to keep them.
+    CodecCache<DecoderStrategy>* codecCache_{};
 };
 
 } // namespace charls
@@ -5,15 +5,25 @@
 #include "constants.h"
 #include "jpeg_marker_code.h"
 #include "jpeg_stream_reader.h"
+#include "jpegls_preset_coding_parameters.h"
 #include "jpegls_preset_parameters_type.h"
+#include "memory.h"
 #include "util.h"
 
 #include <array>
 #include <cassert>
+#include <cstring>
 #include <vector>
 
 using std::array;
-using std::vector;
+
+namespace
+{
+
+// The marker segments are built with the allocator of the codec, reserved up front to allocate once.
+using Segment = std::vector<uint8_t, charls::Allocator<uint8_t>>;
+
+} // namespace
 
 namespace charls
 {
@@ -35,6 +45,39 @@ void JpegStreamWriter::WriteStartOfImage()
 }
 
 
+void JpegStreamWriter::WriteHeader(const CodingParameters& params)
+{
+    WriteStartOfImage();
+
+    if (params.jfif.version != 0)
+    {
+        WriteJpegFileInterchangeFormatSegment(params.jfif);
+    }
+
+    WriteStartOfFrameSegment(params.width, params.height, params.bitsPerSample, params.components);
+
+    if (params.colorTransformation != ColorTransformation::None)
+    {
+        WriteColorTransformSegment(params.colorTransformation);
+    }
+
+    if (!IsDefault(params.custom))
+    {
+        WriteJpegLSPresetParametersSegment(params.custom);
+    }
+    else if (params.bitsPerSample > 12)
+    {
+        const JpegLSPresetCodingParameters preset = ComputeDefault((1 << params.bitsPerSample) - 1, params.allowedLossyError);
+        WriteJpegLSPresetParametersSegment(preset);
+    }
+
+    if (params.restartInterval > 0)
+    {
+        WriteDefineRestartIntervalSegment(params.restartInterval);
+    }
+}
+
+
 void JpegStreamWriter::WriteEndOfImage()
 {
     WriteMarker(JpegMarkerCode::EndOfImage);
@@ -50,7 +93,10 @@ void JpegStreamWriter::WriteJpegFileInterchangeFormatSegment(const JfifParameter
     ASSERT(params.Ythumbnail >= 0 && params.Ythumbnail < 256);
 
     // Create a JPEG APP0 segment in the JPEG File Interchange Format (JFIF), v1.02
-    vector<uint8_t> segment{'J', 'F', 'I', 'F', '\0'};
+    const size_t thumbnailSize = static_cast<size_t>(3) * params.Xthumbnail * params.Ythumbnail;
+    Segment segment;
+    segment.reserve(14 + thumbnailSize);
+    segment.insert(segment.end(), {'J', 'F', 'I', 'F', '\0'});
     push_back(segment, static_cast<uint16_t>(params.version));
     segment.push_back(static_cast<uint8_t>(params.units));
     push_back(segment, static_cast<uint16_t>(params.Xdensity));
@@ -64,8 +110,7 @@ void JpegStreamWriter::WriteJpegFileInterchangeFormatSegment(const JfifParameter
         if (params.thumbnail)
             throw jpegls_error{jpegls_errc::invalid_argument_thumbnail};
 
-        segment.insert(segment.end(), static_cast<uint8_t*>(params.thumbnail),
-                       static_cast<uint8_t*>(params.thumbnail) + static_cast<size_t>(3) * params.Xthumbnail * params.Ythumbnail);
+        segment.insert(segment.end(), static_cast<uint8_t*>(params.thumbnail), static_cast<uint8_t*>(params.thumbnail) + thumbnailSize);
     }
 
     WriteSegment(JpegMarkerCode::ApplicationData0, segment.data(), segment.size());
@@ -80,7 +125,8 @@ void JpegStreamWriter::WriteStartOfFrameSegment(int width, int height, int bitsP
     ASSERT(componentCount > 0 && componentCount <= UINT8_MAX);
 
     // Create a Frame Header as defined in ISO/IEC 14495-1, C.2.2 and T.81, B.2.2
-    vector<uint8_t> segment;
+    Segment segment;
+    segment.reserve(6 + static_cast<size_t>(3) * componentCount);
     segment.push_back(static_cast<uint8_t>(bitsPerSample)); // P = Sample precision
     push_back(segment, static_cast<uint16_t>(height));      // Y = Number of lines
     push_back(segment, static_cast<uint16_t>(width));       // X = Number of samples per line
@@ -111,7 +157,8 @@ void JpegStreamWriter::WriteColorTransformSegment(ColorTransformation transforma
 
 void JpegStreamWriter::WriteJpegLSPresetParametersSegment(const JpegLSPresetCodingParameters& params)
 {
-    vector<uint8_t> segment;
+    Segment segment;
+    segment.reserve(11);
 
     segment.push_back(static_cast<uint8_t>(JpegLSPresetParametersType::PresetCodingParameters));
 
@@ -125,6 +172,19 @@ void JpegStreamWriter::WriteJpegLSPresetParametersSegment(const JpegLSPresetCodi
 }
 
 
+void JpegStreamWriter::WriteDefineRestartIntervalSegment(int restartInterval)
+{
+    ASSERT(restartInterval > 0 && restartInterval <= MaximumRestartInterval);
+
+    // Create a Define Restart Interval segment as defined in T.81, B.2.4.4
+    Segment segment;
+    segment.reserve(2);
+    push_back(segment, static_cast<uint16_t>(restartInterval)); // Ri = Restart interval
+
+    WriteSegment(JpegMarkerCode::DefineRestartInterval, segment.data(), segment.size());
+}
+
+
 void JpegStreamWriter::WriteStartOfScanSegment(int componentCount, int allowedLossyError, InterleaveMode interleaveMode)
 {
     ASSERT(componentCount > 0 && componentCount <= UINT8_MAX);
@@ -134,7 +194,8 @@ void JpegStreamWriter::WriteStartOfScanSegment(int componentCount, int allowedLo
            interleaveMode == InterleaveMode::Sample);
 
     // Create a Scan Header as defined in T.87, C.2.3 and T.81, B.2.3
-    vector<uint8_t> segment;
+    Segment segment;
+    segment.reserve(4 + static_cast<size_t>(2) * componentCount);
 
     segment.push_back(static_cast<uint8_t>(componentCount));
     for (auto i = 0; i < componentCount; ++i)
@@ -152,6 +213,26 @@ void JpegStreamWriter::WriteStartOfScanSegment(int componentCount, int allowedLo
 }
 
 
+void JpegStreamWriter::WriteScanData(const void* data, size_t dataSize)
+{
+    if (destination_.rawStream)
+    {
+        const auto bytesWritten = destination_.rawStream->sputn(static_cast<const char*>(data), static_cast<std::streamsize>(dataSize));
+        if (static_cast<size_t>(bytesWritten) != dataSize)
+            throw jpegls_error{jpegls_errc::destination_buffer_too_small};
+
+        byteOffset_ += dataSize;
+        return;
+    }
+
+    if (dataSize > destination_.count - byteOffset_)
+        throw jpegls_error{jpegls_errc::destination_buffer_too_small};
+
+    std::memcpy(GetPos(), data, dataSize);
+    byteOffset_ += dataSize;
+}
+
+
 void JpegStreamWriter::WriteSegment(JpegMarkerCode markerCode, const void* data, size_t dataSize)
 {
     ASSERT(dataSize <= UINT16_MAX - sizeof(uint16_t));
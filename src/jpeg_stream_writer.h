@@ -4,6 +4,7 @@
 
 #include <charls/jpegls_error.h>
 
+#include "coding_parameters.h"
 #include "jpeg_marker_code.h"
 
 #include <vector>
@@ -48,6 +49,12 @@ class JpegStreamWriter final
     /// <param name="componentCount">The component count.</param>
     void WriteStartOfFrameSegment(int width, int height, int bitsPerSample, int componentCount);
 
+    /// <summary>
+    /// Writes a JPEG-LS Define Restart Interval (DRI) segment.
+    /// </summary>
+    /// <param name="restartInterval">The number of lines in a restart interval.</param>
+    void WriteDefineRestartIntervalSegment(int restartInterval);
+
     /// <summary>
     /// Writes a JPEG-LS Start Of Scan (SOS) segment.
     /// </summary>
@@ -56,6 +63,28 @@ class JpegStreamWriter final
     /// <param name="interleaveMode">The interleave mode of the components.</param>
     void WriteStartOfScanSegment(int componentCount, int allowedLossyError, InterleaveMode interleaveMode);
 
+    /// <summary>
+    /// Writes a restart marker (RSTm), used to combine restart intervals that were encoded into separate buffers.
+    /// </summary>
+    /// <param name="restartIndex">The index of the restart marker in the range [0, 7].</param>
+    void WriteRestartMarker(int restartIndex)
+    {
+        WriteMarker(static_cast<JpegMarkerCode>(static_cast<int>(JpegMarkerCode::StartOfRestartInterval0) + restartIndex));
+    }
+
+    /// <summary>
+    /// Writes the encoded bytes of a scan that was encoded into a separate buffer.
+    /// </summary>
+    /// <param name="data">The encoded bytes of the scan (without the SOS segment).</param>
+    /// <param name="dataSize">The number of bytes.</param>
+    void WriteScanData(const void* data, size_t dataSize);
+
+    /// <summary>
+    /// Writes the SOI marker and the segments that precede the first scan (JFIF, SOF, color transformation, LSE and DRI).
+    /// </summary>
+    /// <param name="params">The parameters of the image.</param>
+    void WriteHeader(const CodingParameters& params);
+
     void WriteEndOfImage();
 
     std::size_t GetBytesWritten() const noexcept
@@ -71,16 +100,17 @@ class JpegStreamWriter final
     ByteStreamInfo OutputStream() const noexcept
     {
         ByteStreamInfo data = destination_;
-        data.count -= byteOffset_;
-        data.rawData += byteOffset_;
+        if (!data.rawStream)
+        {
+            data.count -= byteOffset_;
+            data.rawData += byteOffset_;
+        }
         return data;
     }
 
     void Seek(std::size_t byteCount) noexcept
     {
-        if (destination_.rawStream)
-            return;
-
+        // A stream destination has no position to move, but the written bytes are still counted.
         byteOffset_ += byteCount;
     }
 
@@ -96,7 +126,10 @@ class JpegStreamWriter final
     {
         if (destination_.rawStream)
         {
-            destination_.rawStream->sputc(value);
+            if (std::char_traits<char>::eq_int_type(destination_.rawStream->sputc(static_cast<char>(value)), std::char_traits<char>::eof()))
+                throw jpegls_error{jpegls_errc::destination_buffer_too_small};
+
+            ++byteOffset_;
         }
         else
         {
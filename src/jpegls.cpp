@@ -4,12 +4,21 @@
 #include "encoder_strategy.h"
 #include "lookup_table.h"
 #include "lossless_traits.h"
+#include "near_lossless_traits.h"
 #include "default_traits.h"
 #include "jls_codec_factory.h"
 #include "jpeg_stream_reader.h"
 #include "jpegls_preset_coding_parameters.h"
+#include "memory.h"
 #include "util.h"
 
+#include <algorithm>
+
+#include <array>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 // As defined in the JPEG-LS standard
@@ -21,7 +30,6 @@ const int J[32] = {0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 5, 5, 6
 
 using std::make_unique;
 using std::unique_ptr;
-using std::vector;
 
 namespace
 {
@@ -41,26 +49,152 @@ signed char QuantizeGradientOrg(const JpegLSPresetCodingParameters& preset, int3
 }
 
 
-vector<signed char> CreateQLutLossless(int32_t bitCount)
+template<int32_t BitCount>
+const signed char* LosslessQuantizationLut()
 {
-    const JpegLSPresetCodingParameters preset = charls::ComputeDefault((1u << static_cast<uint32_t>(bitCount)) - 1, 0);
-    const int32_t range = preset.MaximumSampleValue + 1;
+    // Zero initialized static storage: it uses no memory until the LUT is written on first use.
+    static std::array<signed char, static_cast<size_t>(2) << BitCount> lut;
+    static std::once_flag created;
+
+    constexpr int32_t range = 1 << BitCount;
+    std::call_once(created, []() noexcept
+    {
+        const JpegLSPresetCodingParameters preset = charls::ComputeDefault(range - 1, 0);
+        for (int32_t diff = -range; diff < range; diff++)
+        {
+            lut[static_cast<size_t>(range + diff)] = QuantizeGradientOrg(preset, 0, diff);
+        }
+    });
 
-    vector<signed char> lut(static_cast<size_t>(range) * 2);
+    return &lut[range];
+}
 
-    for (int32_t diff = -range; diff < range; diff++)
+template<size_t... K>
+std::array<charls::CTable, sizeof...(K)> CreateDecodingTables(std::index_sequence<K...>)
+{
+    return {{charls::InitTable(K)...}};
+}
+
+// Process-wide cache of the quantization LUTs that are not precomputed: near-lossless coding and custom thresholds or sample ranges.
+// A LUT is shared by the codecs that use it (reference counted), a limited number of LUTs are kept when they are no longer used.
+// The LUTs are allocated with operator new, not with the allocator of the application: the cache can outlive that allocator.
+class QuantizationLutCache final
+{
+public:
+    std::shared_ptr<const charls::QuantizationLut> Get(int32_t bitCount, int32_t near, int32_t t1, int32_t t2, int32_t t3, bool create)
     {
-        lut[static_cast<size_t>(range) + diff] = QuantizeGradientOrg(preset, 0,diff);
+        const Key key{{bitCount, near, t1, t2, t3}};
+        const std::lock_guard<std::mutex> lock{mutex_};
+
+        const auto entry = luts_.find(key);
+        if (entry != luts_.end())
+            return entry->second;
+
+        if (!create)
+            return nullptr;
+
+        if (luts_.size() >= MaximumLutCount)
+        {
+            RemoveUnused();
+        }
+
+        const JpegLSPresetCodingParameters preset{0, t1, t2, t3, 0};
+        const int32_t range = 1 << bitCount;
+        auto lut = std::make_shared<charls::QuantizationLut>(static_cast<size_t>(range) * 2);
+        for (int32_t diff = -range; diff < range; ++diff)
+        {
+            (*lut)[static_cast<size_t>(range + diff)] = QuantizeGradientOrg(preset, near, diff);
+        }
+
+        luts_.emplace(key, lut);
+        return lut;
     }
-    return lut;
-}
+
+private:
+    using Key = std::array<int32_t, 5>;
+    using Lut = std::shared_ptr<const charls::QuantizationLut>;
+
+    // Kept LUTs of 16 bit images use 128 KiB each.
+    static constexpr size_t MaximumLutCount = 16;
+
+    // Removes the LUTs that are only referenced by the cache: other references are only created with the mutex locked.
+    void RemoveUnused() noexcept
+    {
+        for (auto entry = luts_.begin(); entry != luts_.end();)
+        {
+            entry = entry->second.use_count() == 1 ? luts_.erase(entry) : std::next(entry);
+        }
+    }
+
+    std::mutex mutex_;
+    std::map<Key, Lut> luts_;
+};
+
 
 template<typename Strategy, typename Traits>
-unique_ptr<Strategy> create_codec(const Traits& traits, const JlsParameters& params)
+unique_ptr<Strategy> create_codec(const Traits& traits, const charls::CodingParameters& params)
 {
     return make_unique<charls::JlsCodec<Traits, Strategy>>(traits, params);
 }
 
+// Near-lossless codecs with NEAR known at compile time exist for NEAR = 1 .. MaximumOptimizedNear.
+constexpr int32_t MaximumOptimizedNear = 3;
+
+template<typename Strategy, typename Sample, typename Pixel>
+unique_ptr<Strategy> create_near_lossless_codec(const charls::CodingParameters& params)
+{
+    using namespace charls;
+    const int32_t maxval = (1 << params.bitsPerSample) - 1;
+
+    switch (params.allowedLossyError)
+    {
+    case 1: return create_codec<Strategy>(NearLosslessTraits<Sample, Pixel, 1>(maxval), params);
+    case 2: return create_codec<Strategy>(NearLosslessTraits<Sample, Pixel, 2>(maxval), params);
+    case 3: return create_codec<Strategy>(NearLosslessTraits<Sample, Pixel, MaximumOptimizedNear>(maxval), params);
+    default:
+        return nullptr;
+    }
+}
+
+// The size of the largest codec object that the factory creates.
+template<typename Strategy>
+constexpr size_t MaximumCodecSize() noexcept
+{
+    using namespace charls;
+    return std::max({sizeof(JlsCodec<LosslessTraits<Triplet<uint8_t>, 8>, Strategy>),
+                     sizeof(JlsCodec<LosslessTraits<Triplet<uint16_t>, 10>, Strategy>),
+                     sizeof(JlsCodec<LosslessTraits<Triplet<uint16_t>, 12>, Strategy>),
+                     sizeof(JlsCodec<LosslessTraits<Triplet<uint16_t>, 16>, Strategy>),
+                     sizeof(JlsCodec<LosslessTraits<Quad<uint8_t>, 8>, Strategy>),
+                     sizeof(JlsCodec<LosslessTraits<Quad<uint16_t>, 10>, Strategy>),
+                     sizeof(JlsCodec<LosslessTraits<Quad<uint16_t>, 12>, Strategy>),
+                     sizeof(JlsCodec<LosslessTraits<uint8_t, 8>, Strategy>),
+                     sizeof(JlsCodec<LosslessTraits<uint16_t, 10>, Strategy>),
+                     sizeof(JlsCodec<LosslessTraits<uint16_t, 12>, Strategy>),
+                     sizeof(JlsCodec<LosslessTraits<uint16_t, 16>, Strategy>),
+                     sizeof(JlsCodec<NearLosslessTraits<uint8_t, Triplet<uint8_t>, MaximumOptimizedNear>, Strategy>),
+                     sizeof(JlsCodec<NearLosslessTraits<uint8_t, uint8_t, MaximumOptimizedNear>, Strategy>),
+                     sizeof(JlsCodec<NearLosslessTraits<uint16_t, Triplet<uint16_t>, MaximumOptimizedNear>, Strategy>),
+                     sizeof(JlsCodec<NearLosslessTraits<uint16_t, uint16_t, MaximumOptimizedNear>, Strategy>),
+                     sizeof(JlsCodec<DefaultTraits<uint8_t, Triplet<uint8_t>>, Strategy>),
+                     sizeof(JlsCodec<DefaultTraits<uint8_t, Quad<uint8_t>>, Strategy>),
+                     sizeof(JlsCodec<DefaultTraits<uint8_t, uint8_t>, Strategy>),
+                     sizeof(JlsCodec<DefaultTraits<uint16_t, Triplet<uint16_t>>, Strategy>),
+                     sizeof(JlsCodec<DefaultTraits<uint16_t, Quad<uint16_t>>, Strategy>),
+                     sizeof(JlsCodec<DefaultTraits<uint16_t, uint16_t>, Strategy>)});
+}
+
+// The size of the largest ProcessLine object that a codec creates for a scan.
+constexpr size_t MaximumProcessLineSize() noexcept
+{
+    using namespace charls;
+    return std::max({sizeof(PostProcessSingleComponent),
+                     sizeof(PostProcessSingleStream),
+                     sizeof(ProcessTransformed<TransformNone<uint16_t>>),
+                     sizeof(ProcessTransformed<TransformHp3<uint16_t>>),
+                     sizeof(ProcessTransformed<TransformShifted<TransformHp3<uint16_t>>>)});
+}
+
 } // namespace
 
 
@@ -68,23 +202,41 @@ namespace charls
 {
 
 // Lookup tables to replace code with lookup tables.
-// To avoid threading issues, all tables are created when the program is loaded.
+// The tables are created on first use (thread safe): loading the library or only reading headers doesn't pay for them.
+
+// Lookup table: decode symbols that are smaller or equal to CTable::bit_count bits (a table for each value of k).
+// Codes for larger values of k are always longer and are never found in a table.
+const std::array<CTable, CTable::bit_count>& GetDecodingTables()
+{
+    static const std::array<CTable, CTable::bit_count> decodingTables = CreateDecodingTables(std::make_index_sequence<CTable::bit_count>());
+    return decodingTables;
+}
 
-// Lookup table: decode symbols that are smaller or equal to 8 bit (16 tables for each value of k)
-CTable decodingTables[16] = { InitTable(0), InitTable(1), InitTable(2), InitTable(3),
-                              InitTable(4), InitTable(5), InitTable(6), InitTable(7),
-                              InitTable(8), InitTable(9), InitTable(10), InitTable(11),
-                              InitTable(12), InitTable(13), InitTable(14),InitTable(15) };
 
 // Lookup tables: sample differences to bin indexes.
-vector<signed char> rgquant8Ll = CreateQLutLossless(8);
-vector<signed char> rgquant10Ll = CreateQLutLossless(10);
-vector<signed char> rgquant12Ll = CreateQLutLossless(12);
-vector<signed char> rgquant16Ll = CreateQLutLossless(16);
+const signed char* GetLosslessQuantizationLut(int32_t bitCount)
+{
+    switch (bitCount)
+    {
+    case 8: return LosslessQuantizationLut<8>();
+    case 10: return LosslessQuantizationLut<10>();
+    case 12: return LosslessQuantizationLut<12>();
+    case 16: return LosslessQuantizationLut<16>();
+    default:
+        return nullptr;
+    }
+}
+
+
+std::shared_ptr<const QuantizationLut> GetQuantizationLut(int32_t bitCount, int32_t near, int32_t t1, int32_t t2, int32_t t3, bool create)
+{
+    static QuantizationLutCache cache;
+    return cache.Get(bitCount, near, t1, t2, t3, create);
+}
 
 
 template<typename Strategy>
-unique_ptr<Strategy> JlsCodecFactory<Strategy>::CreateCodec(const JlsParameters& params, const JpegLSPresetCodingParameters& presets)
+unique_ptr<Strategy> JlsCodecFactory<Strategy>::CreateCodec(const CodingParameters& params, const JpegLSPresetCodingParameters& presets)
 {
     unique_ptr<Strategy> codec;
 
@@ -114,7 +266,7 @@ unique_ptr<Strategy> JlsCodecFactory<Strategy>::CreateCodec(const JlsParameters&
 }
 
 template<typename Strategy>
-unique_ptr<Strategy> JlsCodecFactory<Strategy>::CreateOptimizedCodec(const JlsParameters& params)
+unique_ptr<Strategy> JlsCodecFactory<Strategy>::CreateOptimizedCodec(const CodingParameters& params)
 {
     if (params.interleaveMode == InterleaveMode::Sample && params.components != 3 && params.components != 4)
         return nullptr;
@@ -126,16 +278,37 @@ unique_ptr<Strategy> JlsCodecFactory<Strategy>::CreateOptimizedCodec(const JlsPa
     {
         if (params.interleaveMode == InterleaveMode::Sample)
         {
-            if (params.components == 3 && params.bitsPerSample == 8)
-                return create_codec<Strategy>(LosslessTraits<Triplet<uint8_t>, 8>(), params);
-            else if (params.components == 4 && params.bitsPerSample == 8)
-                return create_codec<Strategy>(LosslessTraits<Quad<uint8_t>, 8>(), params);
+            if (params.components == 3)
+            {
+                switch (params.bitsPerSample)
+                {
+                case  8: return create_codec<Strategy>(LosslessTraits<Triplet<uint8_t>, 8>(), params);
+                case 10: return create_codec<Strategy>(LosslessTraits<Triplet<uint16_t>, 10>(), params);
+                case 12: return create_codec<Strategy>(LosslessTraits<Triplet<uint16_t>, 12>(), params);
+                case 16: return create_codec<Strategy>(LosslessTraits<Triplet<uint16_t>, 16>(), params);
+                default:
+                    break;
+                }
+            }
+            else
+            {
+                switch (params.bitsPerSample)
+                {
+                case  8: return create_codec<Strategy>(LosslessTraits<Quad<uint8_t>, 8>(), params);
+                case 10: return create_codec<Strategy>(LosslessTraits<Quad<uint16_t>, 10>(), params);
+                case 12: return create_codec<Strategy>(LosslessTraits<Quad<uint16_t>, 12>(), params);
+                default:
+                    break;
+                }
+            }
         }
         else
         {
+            // Line interleaved and single component scans (also of 2 component images) use the monochrome codecs.
             switch (params.bitsPerSample)
             {
             case  8: return create_codec<Strategy>(LosslessTraits<uint8_t, 8>(), params);
+            case 10: return create_codec<Strategy>(LosslessTraits<uint16_t, 10>(), params);
             case 12: return create_codec<Strategy>(LosslessTraits<uint16_t, 12>(), params);
             case 16: return create_codec<Strategy>(LosslessTraits<uint16_t, 16>(), params);
                 default:
@@ -144,6 +317,22 @@ unique_ptr<Strategy> JlsCodecFactory<Strategy>::CreateOptimizedCodec(const JlsPa
         }
     }
 
+    // optimized near-lossless versions for small NEAR values of monochrome and RGB images
+    if (params.allowedLossyError > 0 && params.allowedLossyError <= MaximumOptimizedNear)
+    {
+        if (params.interleaveMode != InterleaveMode::Sample)
+        {
+            return params.bitsPerSample <= 8 ? create_near_lossless_codec<Strategy, uint8_t, uint8_t>(params) :
+                                               create_near_lossless_codec<Strategy, uint16_t, uint16_t>(params);
+        }
+
+        if (params.components == 3)
+        {
+            return params.bitsPerSample <= 8 ? create_near_lossless_codec<Strategy, uint8_t, Triplet<uint8_t>>(params) :
+                                               create_near_lossless_codec<Strategy, uint16_t, Triplet<uint16_t>>(params);
+        }
+    }
+
 #endif
 
     const int maxval = (1u << static_cast<unsigned int>(params.bitsPerSample)) - 1;
@@ -179,4 +368,31 @@ unique_ptr<Strategy> JlsCodecFactory<Strategy>::CreateOptimizedCodec(const JlsPa
 template class JlsCodecFactory<DecoderStrategy>;
 template class JlsCodecFactory<EncoderStrategy>;
 
+
+// Sums the allocations of a call that encodes or decodes the image sequentially, every allocation can need alignment padding.
+// Released memory is not reused by a scratch arena: memory allocated per scan is counted for every scan.
+size_t GetScratchSize(const JlsParameters& params)
+{
+    constexpr size_t padding = ScratchArena::alignment - 1;
+    const size_t components = static_cast<size_t>(params.components);
+    const size_t scanCount = params.interleaveMode == InterleaveMode::None ? components : 1;
+    const size_t sampleSize = params.bitsPerSample > 8 ? sizeof(uint16_t) : sizeof(uint8_t);
+    const size_t lineSize = static_cast<size_t>(params.width) * components * sizeof(uint32_t);
+
+    size_t size = std::max(MaximumCodecSize<EncoderStrategy>(), MaximumCodecSize<DecoderStrategy>()) + padding;
+    size += 2 * (static_cast<size_t>(params.width) + 4) * components * sampleSize + padding; // line buffers
+    size += components * sizeof(int32_t) + padding;                                         // run indexes
+    size += (static_cast<size_t>(2) << params.bitsPerSample) + padding;                     // quantization LUT
+    size += 40000 + padding;                                                                 // buffer of a stream or fragment boundary
+    size += scanCount * (MaximumProcessLineSize() + padding) + 2 * (lineSize + padding);    // ProcessLine objects and transform buffers
+    size += components * (2 * sampleSize + sizeof(size_t)) + 3 * padding;                   // component selection
+
+    // Marker segments: SOF, LSE, DRI, SOS of every scan and JFIF with thumbnail.
+    size += 6 + 3 * components + 11 + 2 + 3 * padding;
+    size += scanCount * (4 + 2 * (components / scanCount) + padding);
+    size += 14 + static_cast<size_t>(3) * params.jfif.Xthumbnail * params.jfif.Ythumbnail + padding;
+
+    return size;
+}
+
 } // namespace charls
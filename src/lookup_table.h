@@ -5,6 +5,14 @@
 #include <cstring>
 #include <array>
 #include <cassert>
+#include <type_traits>
+
+// Number of bits used to index the tables for fast decoding of short Golomb codes (8 - 16).
+// Wider tables decode more codes with a single lookup, but require more (cache) memory:
+// 10 bits requires 2 KB per table, 12 bits 8 KB per table. Above 12 bits the entries are 32 bit.
+#ifndef CHARLS_DECODING_TABLE_BITS
+#define CHARLS_DECODING_TABLE_BITS 10
+#endif
 
 namespace charls
 {
@@ -38,32 +46,54 @@ struct Code final
 class CTable final
 {
 public:
-    static constexpr size_t byte_bit_count = 8;
+    static constexpr size_t bit_count = CHARLS_DECODING_TABLE_BITS;
+    static_assert(bit_count >= 8 && bit_count <= 16, "CHARLS_DECODING_TABLE_BITS should be in the range [8, 16]");
 
     CTable() noexcept
     {
-        std::memset(types_.data(), 0, sizeof(types_)); // TODO: analyze if needed
+        std::memset(entries_.data(), 0, sizeof(entries_));
     }
 
-    void AddEntry(uint8_t value, Code c) noexcept
+    void AddEntry(uint32_t value, Code c) noexcept
     {
         const int32_t length = c.GetLength();
-        ASSERT(static_cast<size_t>(length) <= byte_bit_count);
+        ASSERT(static_cast<size_t>(length) <= bit_count && length > 0);
+
+        const entry_type entry = Pack(c);
+        ASSERT(Unpack(entry).GetValue() == c.GetValue());
 
-        for (int32_t i = 0; i < 1 << (byte_bit_count - length); ++i)
+        for (int32_t i = 0; i < 1 << (bit_count - length); ++i)
         {
-            ASSERT(types_[(static_cast<size_t>(value) << (byte_bit_count - length)) + i].GetLength() == 0);
-            types_[(static_cast<size_t>(value) << (byte_bit_count - length)) + i] = c;
+            ASSERT(entries_[(static_cast<size_t>(value) << (bit_count - length)) + i] == 0);
+            entries_[(static_cast<size_t>(value) << (bit_count - length)) + i] = entry;
         }
     }
 
-    FORCE_INLINE const Code& Get(int32_t value) const noexcept
+    // Returns the code for the next bit_count bits of the stream, the length is 0 if the code doesn't fit in the table.
+    FORCE_INLINE Code Get(int32_t value) const noexcept
     {
-        return types_[value];
+        return Unpack(entries_[value]);
     }
 
 private:
-    std::array<Code, 1 << byte_bit_count> types_;
+    // The value and length of a code are packed in a single entry: a 16 bit entry has room for the
+    // length (max 12, 4 bits) and the error value (max 11 bits for codes of 12 bits).
+    using entry_type = std::conditional<bit_count <= 12, uint16_t, uint32_t>::type;
+    using signed_entry_type = std::make_signed<entry_type>::type;
+    static constexpr int32_t length_bit_count = bit_count <= 12 ? 4 : 8;
+
+    static entry_type Pack(const Code& c) noexcept
+    {
+        return static_cast<entry_type>((static_cast<uint32_t>(c.GetValue()) << length_bit_count) | static_cast<uint32_t>(c.GetLength()));
+    }
+
+    FORCE_INLINE static Code Unpack(entry_type entry) noexcept
+    {
+        // Note: the value is signed, right shift of negative values is arithmetic on all supported compilers.
+        return {static_cast<signed_entry_type>(entry) >> length_bit_count, static_cast<int32_t>(entry & ((1U << length_bit_count) - 1))};
+    }
+
+    std::array<entry_type, 1 << bit_count> entries_;
 };
 
 } // namespace charls
@@ -8,7 +8,7 @@
 namespace charls
 {
 
-// Optimized trait classes for lossless compression of 8 bit color and 8/16 bit monochrome images.
+// Optimized trait classes for lossless compression of 8/10/12/16 bit monochrome and color images.
 // This class assumes MaximumSampleValue correspond to a whole number of bits, and no custom ResetValue is set when encoding.
 // The point of this is to have the most optimized code for the most common and most demanding scenario.
 template<typename sample, int32_t bitsPerPixel>
@@ -129,7 +129,8 @@ struct LosslessTraits<Triplet<T>, bpp> final : LosslessTraitsImpl<T, bpp>
 
     FORCE_INLINE static T ComputeReconstructedSample(int32_t Px, int32_t errorValue) noexcept
     {
-        return static_cast<T>(Px + errorValue);
+        // The mask is needed when the sample type is wider than bpp (10 and 12 bit samples in 16 bit), it is free otherwise.
+        return static_cast<T>((Px + errorValue) & LosslessTraitsImpl<T, bpp>::MAXVAL);
     }
 };
 
@@ -151,7 +152,7 @@ struct LosslessTraits<Quad<T>, bpp> final : LosslessTraitsImpl<T, bpp>
 
     FORCE_INLINE static T ComputeReconstructedSample(int32_t Px, int32_t errorValue) noexcept
     {
-        return static_cast<T>(Px + errorValue);
+        return static_cast<T>((Px + errorValue) & LosslessTraitsImpl<T, bpp>::MAXVAL);
     }
 };
 
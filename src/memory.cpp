@@ -0,0 +1,98 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#include "memory.h"
+
+using namespace charls;
+
+namespace
+{
+
+// The allocator of the application, set before the codec is used (it is not synchronized with running calls).
+charls_allocate_handler allocateHandler{};
+charls_free_handler freeHandler{};
+void* allocatorUserContext{};
+
+// The scratch arena of the call that runs on this thread.
+thread_local ScratchArena* currentArena{};
+
+} // namespace
+
+
+namespace charls
+{
+
+void* Allocate(std::size_t size)
+{
+    if (currentArena)
+        return currentArena->Allocate(size);
+
+    if (!allocateHandler)
+        return ::operator new(size);
+
+    void* memory = allocateHandler(allocatorUserContext, size);
+    if (!memory)
+        throw std::bad_alloc();
+
+    return memory;
+}
+
+
+void Free(void* memory) noexcept
+{
+    if (!memory || (currentArena && currentArena->Contains(memory)))
+        return;
+
+    if (freeHandler)
+    {
+        freeHandler(allocatorUserContext, memory);
+    }
+    else
+    {
+        ::operator delete(memory);
+    }
+}
+
+
+void SetAllocator(charls_allocate_handler allocate, charls_free_handler free, void* userContext) noexcept
+{
+    allocateHandler = allocate;
+    freeHandler = free;
+    allocatorUserContext = userContext;
+}
+
+
+bool IsScratchActive() noexcept
+{
+    return currentArena != nullptr;
+}
+
+
+void* ScratchArena::Allocate(std::size_t size)
+{
+    // The buffer of the application can have any alignment.
+    const std::size_t padding = (alignment - reinterpret_cast<std::uintptr_t>(begin_ + used_) % alignment) % alignment;
+    if (padding > size_ - used_ || size > size_ - used_ - padding)
+        throw std::bad_alloc();
+
+    void* memory = begin_ + used_ + padding;
+    used_ += padding + size;
+    return memory;
+}
+
+
+ScratchScope::ScratchScope(ScratchArena& arena) noexcept :
+    previous_{currentArena}
+{
+    if (arena.HasBuffer())
+    {
+        currentArena = &arena;
+    }
+}
+
+
+ScratchScope::~ScratchScope()
+{
+    currentArena = previous_;
+}
+
+} // namespace charls
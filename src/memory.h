@@ -0,0 +1,162 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#pragma once
+
+#include <charls/charls.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+
+namespace charls
+{
+
+/// <summary>
+/// Allocates memory for the codec: from the scratch arena of the current call when one is active (see ScratchScope),
+/// otherwise with the allocator set by charls_set_allocator (operator new by default). Throws std::bad_alloc when it fails.
+/// </summary>
+void* Allocate(std::size_t size);
+
+/// <summary>
+/// Releases memory returned by Allocate, memory of a scratch arena is reused when the arena is reset.
+/// </summary>
+void Free(void* memory) noexcept;
+
+/// <summary>
+/// Sets the allocator that is used when no scratch arena is active, null handlers restore the default (operator new and delete).
+/// </summary>
+void SetAllocator(charls_allocate_handler allocate, charls_free_handler free, void* userContext) noexcept;
+
+/// <summary>
+/// Returns true when the calling thread allocates from a scratch arena: memory that outlives the call must not be allocated.
+/// </summary>
+bool IsScratchActive() noexcept;
+
+
+/// <summary>
+/// Standard library allocator that allocates with Allocate: used by the containers of the codec.
+/// </summary>
+template<typename T>
+class Allocator
+{
+public:
+    using value_type = T;
+
+    Allocator() noexcept = default;
+
+    template<typename U>
+    Allocator(const Allocator<U>& /*other*/) noexcept // NOLINT(google-explicit-constructor)
+    {
+    }
+
+    T* allocate(std::size_t count)
+    {
+        if (count > std::numeric_limits<std::size_t>::max() / sizeof(T))
+            throw std::bad_alloc();
+
+        return static_cast<T*>(Allocate(count * sizeof(T)));
+    }
+
+    void deallocate(T* memory, std::size_t /*count*/) noexcept
+    {
+        Free(memory);
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const Allocator<T>& /*lhs*/, const Allocator<U>& /*rhs*/) noexcept
+{
+    return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const Allocator<T>& /*lhs*/, const Allocator<U>& /*rhs*/) noexcept
+{
+    return false;
+}
+
+
+/// <summary>
+/// Base class of the classes that are created on the heap by the codec (codecs, ProcessLine objects): they are created with Allocate.
+/// </summary>
+class Allocated
+{
+public:
+    static void* operator new(std::size_t size)
+    {
+        return Allocate(size);
+    }
+
+    static void operator delete(void* memory) noexcept
+    {
+        Free(memory);
+    }
+
+protected:
+    Allocated() = default;
+    ~Allocated() = default;
+};
+
+
+/// <summary>
+/// Bump allocator over a buffer of the application: an encode or decode call allocates all its memory from it, without the heap.
+/// Released memory is not reused, the arena is reset when the call is done.
+/// </summary>
+class ScratchArena final
+{
+public:
+    // Every allocation is aligned for any object type, as memory returned by operator new.
+    static constexpr std::size_t alignment = alignof(std::max_align_t);
+
+    void SetBuffer(void* buffer, std::size_t size) noexcept
+    {
+        begin_ = static_cast<uint8_t*>(buffer);
+        size_ = buffer ? size : 0;
+        used_ = 0;
+    }
+
+    bool HasBuffer() const noexcept
+    {
+        return size_ != 0;
+    }
+
+    void* Allocate(std::size_t size);
+
+    bool Contains(const void* memory) const noexcept
+    {
+        const auto address = static_cast<const uint8_t*>(memory);
+        return address >= begin_ && address < begin_ + size_;
+    }
+
+    void Reset() noexcept
+    {
+        used_ = 0;
+    }
+
+private:
+    uint8_t* begin_{};
+    std::size_t size_{};
+    std::size_t used_{};
+};
+
+
+/// <summary>
+/// Makes a scratch arena the source of all allocations of the calling thread until the scope ends, an arena without buffer is ignored.
+/// </summary>
+class ScratchScope final
+{
+public:
+    explicit ScratchScope(ScratchArena& arena) noexcept;
+    ~ScratchScope();
+
+    ScratchScope(const ScratchScope&) = delete;
+    ScratchScope(ScratchScope&&) = delete;
+    ScratchScope& operator=(const ScratchScope&) = delete;
+    ScratchScope& operator=(ScratchScope&&) = delete;
+
+private:
+    ScratchArena* previous_;
+};
+
+} // namespace charls
@@ -0,0 +1,129 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#pragma once
+
+#include "util.h"
+#include "constants.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+namespace charls
+{
+
+// Optimized trait classes for near-lossless coding with a small NEAR value that is known at compile time.
+// MAXVAL is set at runtime as with DefaultTraits, no custom ResetValue is supported.
+// The quantization divides by the constant (2 * NEAR + 1): the compiler replaces the division with a multiplication by the reciprocal.
+template<typename sample, typename pixel, int32_t near>
+struct NearLosslessTraits final
+{
+    using SAMPLE = sample;
+    using PIXEL = pixel;
+
+    enum
+    {
+        NEAR = near,
+        RESET = DefaultResetValue
+    };
+
+    const int32_t MAXVAL;
+    const int32_t RANGE;
+    const int32_t qbpp;
+    const int32_t bpp;
+    const int32_t LIMIT;
+
+    explicit NearLosslessTraits(int32_t max) noexcept :
+        MAXVAL{max},
+        RANGE{(max + 2 * NEAR) / (2 * NEAR + 1) + 1},
+        qbpp{log_2(RANGE)},
+        bpp{log_2(max)},
+        LIMIT{2 * (bpp + std::max(8, bpp))}
+    {
+    }
+
+    NearLosslessTraits() = delete;
+    NearLosslessTraits(const NearLosslessTraits&) noexcept = default;
+    NearLosslessTraits(NearLosslessTraits&&) noexcept = default;
+    ~NearLosslessTraits() = default;
+    NearLosslessTraits& operator=(const NearLosslessTraits&) = delete;
+    NearLosslessTraits& operator=(NearLosslessTraits&&) = delete;
+
+    FORCE_INLINE int32_t ComputeErrVal(int32_t e) const noexcept
+    {
+        return ModuloRange(Quantize(e));
+    }
+
+    FORCE_INLINE SAMPLE ComputeReconstructedSample(int32_t Px, int32_t ErrVal) const noexcept
+    {
+        return FixReconstructedValue(Px + ErrVal * (2 * NEAR + 1));
+    }
+
+    FORCE_INLINE constexpr static bool IsNear(int32_t lhs, int32_t rhs) noexcept
+    {
+        return static_cast<uint32_t>(lhs - rhs + NEAR) <= 2 * NEAR;
+    }
+
+    FORCE_INLINE static bool IsNear(Triplet<SAMPLE> lhs, Triplet<SAMPLE> rhs) noexcept
+    {
+        return IsNear(lhs.v1, rhs.v1) && IsNear(lhs.v2, rhs.v2) && IsNear(lhs.v3, rhs.v3);
+    }
+
+    FORCE_INLINE static bool IsNear(Quad<SAMPLE> lhs, Quad<SAMPLE> rhs) noexcept
+    {
+        return IsNear(lhs.v1, rhs.v1) && IsNear(lhs.v2, rhs.v2) && IsNear(lhs.v3, rhs.v3) && IsNear(lhs.v4, rhs.v4);
+    }
+
+    FORCE_INLINE int32_t CorrectPrediction(int32_t Pxc) const noexcept
+    {
+        if ((Pxc & MAXVAL) == Pxc)
+            return Pxc;
+
+        return (~(Pxc >> (int32_t_bit_count-1))) & MAXVAL;
+    }
+
+    /// <summary>
+    /// Returns the value of errorValue modulo RANGE. ITU.T.87, A.4.5 (code segment A.9)
+    /// </summary>
+    FORCE_INLINE int32_t ModuloRange(int32_t errorValue) const noexcept
+    {
+        ASSERT(std::abs(errorValue) <= RANGE);
+
+        if (errorValue < 0)
+        {
+            errorValue += RANGE;
+        }
+        if (errorValue >= (RANGE + 1) / 2)
+        {
+            errorValue -= RANGE;
+        }
+
+        return errorValue;
+    }
+
+private:
+    // The sign is known in both branches: the unsigned division by the constant is a multiplication and a shift.
+    FORCE_INLINE static int32_t Quantize(int32_t errorValue) noexcept
+    {
+        if (errorValue > 0)
+            return static_cast<int32_t>(static_cast<uint32_t>(errorValue + NEAR) / (2 * NEAR + 1));
+
+        return -static_cast<int32_t>(static_cast<uint32_t>(NEAR - errorValue) / (2 * NEAR + 1));
+    }
+
+    FORCE_INLINE SAMPLE FixReconstructedValue(int32_t value) const noexcept
+    {
+        if (value < -NEAR)
+        {
+            value = value + RANGE * (2 * NEAR + 1);
+        }
+        else if (value > MAXVAL + NEAR)
+        {
+            value = value - RANGE * (2 * NEAR + 1);
+        }
+
+        return static_cast<SAMPLE>(CorrectPrediction(value));
+    }
+};
+
+} // namespace charls
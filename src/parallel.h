@@ -0,0 +1,79 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace charls
+{
+
+/// <summary>
+/// Calls function(index) for all indices in the range [0, count) using at most threadCount threads (including the calling thread).
+/// When one or more calls throw an exception, the exception of the call with the lowest index is re-thrown after all threads are finished.
+/// </summary>
+template<typename Function>
+void ParallelFor(int32_t count, int32_t threadCount, Function function)
+{
+    threadCount = std::min(threadCount, count);
+    if (threadCount <= 1)
+    {
+        for (int32_t index = 0; index < count; ++index)
+        {
+            function(index);
+        }
+        return;
+    }
+
+    std::vector<std::exception_ptr> exceptions(count);
+    std::atomic<int32_t> nextIndex{0};
+
+    const auto worker = [&]() noexcept
+    {
+        for (int32_t index = nextIndex++; index < count; index = nextIndex++)
+        {
+            try
+            {
+                function(index);
+            }
+            catch (...)
+            {
+                exceptions[index] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    try
+    {
+        for (int32_t i = 1; i < threadCount; ++i)
+        {
+            threads.emplace_back(worker);
+        }
+    }
+    catch (const std::system_error&)
+    {
+        // Not able to create more threads: the already created threads and the calling thread will process all indices.
+    }
+
+    worker();
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (const auto& exception : exceptions)
+    {
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+}
+
+} // namespace charls
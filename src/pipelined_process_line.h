@@ -0,0 +1,288 @@
+// Copyright (c) Team CharLS. All rights reserved. See the accompanying "LICENSE.md" for licensed use.
+
+#pragma once
+
+#include "process_line.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace charls
+{
+
+/// <summary>
+/// Lock-free ring of line buffers for exactly one producer thread and one consumer thread.
+/// </summary>
+class LineRing final : public Allocated
+{
+public:
+    LineRing(size_t lineSize, size_t lineCount) :
+        buffer_(lineSize * lineCount),
+        lineSize_{lineSize},
+        lineCount_{lineCount}
+    {
+    }
+
+    bool Full() const noexcept
+    {
+        return writeCount_.load(std::memory_order_relaxed) - readCount_.load(std::memory_order_acquire) == lineCount_;
+    }
+
+    bool Empty() const noexcept
+    {
+        return readCount_.load(std::memory_order_relaxed) == writeCount_.load(std::memory_order_acquire);
+    }
+
+    uint8_t* WriteLine() noexcept
+    {
+        return Line(writeCount_.load(std::memory_order_relaxed));
+    }
+
+    void CommitWrite() noexcept
+    {
+        writeCount_.store(writeCount_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    const uint8_t* ReadLine() noexcept
+    {
+        return Line(readCount_.load(std::memory_order_relaxed));
+    }
+
+    void CommitRead() noexcept
+    {
+        readCount_.store(readCount_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    uint8_t* Line(size_t count) noexcept
+    {
+        return &buffer_[(count % lineCount_) * lineSize_];
+    }
+
+    std::vector<uint8_t, Allocator<uint8_t>> buffer_;
+    size_t lineSize_;
+    size_t lineCount_;
+    std::atomic<size_t> writeCount_{0};
+    std::atomic<size_t> readCount_{0};
+};
+
+
+/// <summary>
+/// Lets a thread wait until the other thread of a LineRing has made progress. The waiting thread first spins for a short while
+/// (the other thread usually needs less than the time of a line), then it blocks: a stalled stage doesn't keep a core busy.
+/// Notify only takes the mutex when a thread is blocked, it is called after every change of the state that a thread can wait for.
+/// </summary>
+class LineSignal final
+{
+public:
+    template<typename Predicate>
+    void Wait(Predicate ready)
+    {
+        constexpr int spinCount = 64;
+        for (int i = 0; i < spinCount; ++i)
+        {
+            if (ready())
+                return;
+
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock{mutex_};
+        blockedCount_.fetch_add(1, std::memory_order_acq_rel);
+        condition_.wait(lock, ready);
+        blockedCount_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void Notify()
+    {
+        // A read-modify-write, ordered with the one in Wait: either the waiting thread sees the new state or Notify sees the blocked thread.
+        if (blockedCount_.fetch_add(0, std::memory_order_acq_rel) == 0)
+            return;
+
+        const std::lock_guard<std::mutex> lock{mutex_};
+        condition_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::atomic<int> blockedCount_{0};
+};
+
+
+/// <summary>
+/// Decorates a ProcessLine object and runs it on a separate thread, connected by a ring of line buffers:
+/// - decoding: decoded lines are copied into the ring and post-processed (color transform, deinterleave, copy to the destination)
+///   while the next lines are decoded.
+/// - encoding: the lines of the scan are read and transformed ahead into the ring while the entropy coder encodes the previous lines.
+/// Errors of the worker thread are reported by the call that needs the failed line or by Flush.
+/// </summary>
+class PipelinedProcessLine final : public ProcessLine
+{
+public:
+    /// <param name="processLine">The ProcessLine object that processes the lines on the worker thread.</param>
+    /// <param name="rowCount">The number of rows (stride apart) in the buffer of a line, more than 1 for line interleaved scans.</param>
+    /// <param name="pixelSize">The size of a pixel in the line buffer, in bytes.</param>
+    /// <param name="lineCount">The number of lines of the scan, all are prepared ahead when encoding.</param>
+    PipelinedProcessLine(std::unique_ptr<ProcessLine> processLine, int32_t rowCount, size_t pixelSize, int32_t lineCount) noexcept :
+        processLine_{std::move(processLine)},
+        rowCount_{rowCount},
+        pixelSize_{pixelSize},
+        lineCount_{lineCount}
+    {
+    }
+
+    ~PipelinedProcessLine()
+    {
+        stopped_.store(true, std::memory_order_release);
+        signal_.Notify();
+        if (worker_.joinable())
+        {
+            worker_.join();
+        }
+    }
+
+    PipelinedProcessLine(const PipelinedProcessLine&) = delete;
+    PipelinedProcessLine(PipelinedProcessLine&&) = delete;
+    PipelinedProcessLine& operator=(const PipelinedProcessLine&) = delete;
+    PipelinedProcessLine& operator=(PipelinedProcessLine&&) = delete;
+
+    void NewLineDecoded(const void* pSrc, int pixelCount, int sourceStride) override
+    {
+        if (!ring_)
+        {
+            Start(pixelCount, sourceStride, &PipelinedProcessLine::PostProcessLines);
+        }
+
+        signal_.Wait([this] { return !ring_->Full() || failed_.load(std::memory_order_acquire); });
+        ThrowIfFailed();
+
+        std::memcpy(ring_->WriteLine(), pSrc, lineSize_);
+        ring_->CommitWrite();
+        signal_.Notify();
+    }
+
+    void NewLineRequested(void* pDest, int pixelCount, int destStride) override
+    {
+        if (!ring_)
+        {
+            Start(pixelCount, destStride, &PipelinedProcessLine::PrepareLines);
+        }
+
+        signal_.Wait([this] { return !ring_->Empty() || failed_.load(std::memory_order_acquire); });
+        if (ring_->Empty())
+        {
+            ThrowIfFailed();
+        }
+
+        std::memcpy(pDest, ring_->ReadLine(), lineSize_);
+        ring_->CommitRead();
+        signal_.Notify();
+    }
+
+    void Flush() override
+    {
+        if (!worker_.joinable())
+            return;
+
+        finished_.store(true, std::memory_order_release);
+        signal_.Notify();
+        worker_.join();
+        ThrowIfFailed();
+    }
+
+private:
+    void Start(int pixelCount, int stride, void (PipelinedProcessLine::*work)())
+    {
+        pixelCount_ = pixelCount;
+        stride_ = stride;
+        lineSize_ = (static_cast<size_t>(rowCount_ - 1) * stride + pixelCount) * pixelSize_;
+        constexpr size_t ringLineCount = 16;
+        ring_ = std::make_unique<LineRing>(lineSize_, ringLineCount);
+        worker_ = std::thread([this, work] { (this->*work)(); });
+    }
+
+    void PostProcessLines() noexcept
+    {
+        try
+        {
+            while (!stopped_.load(std::memory_order_acquire))
+            {
+                // Read the finished flag before the ring state: all lines written before the flag was set are processed.
+                const bool finished = finished_.load(std::memory_order_acquire);
+                if (ring_->Empty())
+                {
+                    if (finished)
+                        return;
+
+                    signal_.Wait([this] {
+                        return !ring_->Empty() || finished_.load(std::memory_order_acquire) || stopped_.load(std::memory_order_acquire);
+                    });
+                    continue;
+                }
+
+                processLine_->NewLineDecoded(ring_->ReadLine(), pixelCount_, stride_);
+                ring_->CommitRead();
+                signal_.Notify();
+            }
+        }
+        catch (...)
+        {
+            exception_ = std::current_exception();
+            failed_.store(true, std::memory_order_release);
+            signal_.Notify();
+        }
+    }
+
+    void PrepareLines() noexcept
+    {
+        try
+        {
+            for (int32_t line = 0; line < lineCount_; ++line)
+            {
+                signal_.Wait([this] { return !ring_->Full() || stopped_.load(std::memory_order_acquire); });
+                if (stopped_.load(std::memory_order_acquire))
+                    return;
+
+                processLine_->NewLineRequested(ring_->WriteLine(), pixelCount_, stride_);
+                ring_->CommitWrite();
+                signal_.Notify();
+            }
+        }
+        catch (...)
+        {
+            exception_ = std::current_exception();
+            failed_.store(true, std::memory_order_release);
+            signal_.Notify();
+        }
+    }
+
+    void ThrowIfFailed() const
+    {
+        if (failed_.load(std::memory_order_acquire))
+            std::rethrow_exception(exception_);
+    }
+
+    std::unique_ptr<ProcessLine> processLine_;
+    int32_t rowCount_;
+    size_t pixelSize_;
+    int32_t lineCount_;
+    int pixelCount_{};
+    int stride_{};
+    size_t lineSize_{};
+    std::unique_ptr<LineRing> ring_;
+    std::exception_ptr exception_;
+    std::atomic<bool> failed_{false};
+    std::atomic<bool> finished_{false};
+    std::atomic<bool> stopped_{false};
+    LineSignal signal_;
+    std::thread worker_;
+};
+
+} // namespace charls
@@ -5,6 +5,7 @@
 #include <charls/jpegls_error.h>
 
 #include "util.h"
+#include "memory.h"
 
 #include <vector>
 #include <sstream>
@@ -24,7 +25,7 @@
 namespace charls
 {
 
-class ProcessLine
+class ProcessLine : public Allocated
 {
 public:
     virtual ~ProcessLine() = default;
@@ -37,6 +38,11 @@ class ProcessLine
     virtual void NewLineDecoded(const void* pSrc, int pixelCount, int sourceStride) = 0;
     virtual void NewLineRequested(void* pDest, int pixelCount, int destStride) = 0;
 
+    // Called after the last line of a scan, implementations that process lines asynchronously complete their work.
+    virtual void Flush()
+    {
+    }
+
 protected:
     ProcessLine() = default;
 };
@@ -359,8 +365,8 @@ class ProcessTransformed final : public ProcessLine
     using size_type = typename TRANSFORM::size_type;
 
     const JlsParameters& params_;
-    std::vector<size_type> tempLine_;
-    std::vector<uint8_t> buffer_;
+    std::vector<size_type, Allocator<size_type>> tempLine_;
+    std::vector<uint8_t, Allocator<uint8_t>> buffer_;
     TRANSFORM transform_;
     typename TRANSFORM::Inverse inverseTransform_;
     ByteStreamInfo rawPixels_;
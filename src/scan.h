@@ -2,25 +2,40 @@
 
 #pragma once
 
+#include "constants.h"
 #include "lookup_table.h"
+#include "intrinsics.h"
 #include "context_run_mode.h"
 #include "context.h"
 #include "color_transform.h"
 #include "process_line.h"
+#include "pipelined_process_line.h"
+#include "memory.h"
 
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 #include <array>
+#include <memory>
 
 // This file contains the code for handling a "scan". Usually an image is encoded as a single scan.
 
 namespace charls
 {
 
-extern CTable decodingTables[16];
-extern std::vector<signed char> rgquant8Ll;
-extern std::vector<signed char> rgquant10Ll;
-extern std::vector<signed char> rgquant12Ll;
-extern std::vector<signed char> rgquant16Ll;
+// The lookup tables to decode short Golomb codes (a table for each value of k), created on first use.
+const std::array<CTable, CTable::bit_count>& GetDecodingTables();
+
+// Returns the middle of the precomputed quantization LUT of lossless coding with default thresholds, created on first use per bit count.
+// Returns nullptr for bit counts other than 8, 10, 12 and 16.
+const signed char* GetLosslessQuantizationLut(int32_t bitCount);
+
+using QuantizationLut = std::vector<signed char>;
+
+// Returns the quantization LUT for the parameters from a process-wide cache, the LUT is shared by all codecs that use it.
+// When it's not cached yet it's created, unless create is false: nullptr is then returned.
+// As the precomputed LUTs, the cache outlives the calls and uses the standard heap (not the allocator of the application).
+std::shared_ptr<const QuantizationLut> GetQuantizationLut(int32_t bitCount, int32_t near, int32_t t1, int32_t t2, int32_t t3, bool create);
 
 constexpr int32_t ApplySign(int32_t i, int32_t sign) noexcept
 {
@@ -95,6 +110,233 @@ constexpr int32_t ComputeContextID(int32_t Q1, int32_t Q2, int32_t Q3) noexcept
 }
 
 
+// Fills a run of pixels with the same value: single sample pixels are written with fill_n (memset or vector stores).
+template<typename SAMPLE>
+void FillPixels(SAMPLE* destination, int32_t count, SAMPLE value) noexcept
+{
+    std::fill_n(destination, count, value);
+}
+
+
+// Multi sample pixels: fill a small block and duplicate the filled part with memcpy until the run is complete.
+template<typename PIXEL>
+void FillMultiSamplePixels(PIXEL* destination, int32_t count, PIXEL value) noexcept
+{
+    int32_t filled = std::min(count, 16);
+    std::fill_n(destination, filled, value);
+
+    while (filled < count)
+    {
+        const int32_t copyCount = std::min(filled, count - filled);
+        std::memcpy(destination + filled, destination, static_cast<size_t>(copyCount) * sizeof(PIXEL));
+        filled += copyCount;
+    }
+}
+
+
+template<typename SAMPLE>
+void FillPixels(Triplet<SAMPLE>* destination, int32_t count, Triplet<SAMPLE> value) noexcept
+{
+    FillMultiSamplePixels(destination, count, value);
+}
+
+
+template<typename SAMPLE>
+void FillPixels(Quad<SAMPLE>* destination, int32_t count, Quad<SAMPLE> value) noexcept
+{
+    FillMultiSamplePixels(destination, count, value);
+}
+
+
+#if defined(CHARLS_SSE2) || defined(CHARLS_NEON)
+
+// Run mode detection compares 16 bytes at a time against a pattern of the run value.
+// The pattern is 48 bytes, a multiple of all pixel sizes (1, 2, 3, 4, 6 and 8 bytes), so 3 consecutive
+// 16 byte blocks of the pattern always line up with the pixels.
+constexpr size_t run_pattern_size = 48;
+
+#if defined(CHARLS_SSE2)
+
+// Returns the index of the first byte that differs, or 16 if all bytes are equal.
+inline int32_t FindFirstMismatch(const uint8_t* values, const uint8_t* pattern) noexcept
+{
+    const __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values)),
+                                         _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern)));
+    const auto mismatch = static_cast<uint32_t>(~_mm_movemask_epi8(equal)) & 0xFFFFU;
+    return mismatch == 0 ? 16 : count_trailing_zeros(mismatch);
+}
+
+inline __m128i AbsoluteDifference(__m128i lhs, __m128i rhs, uint8_t) noexcept
+{
+    return _mm_or_si128(_mm_subs_epu8(lhs, rhs), _mm_subs_epu8(rhs, lhs));
+}
+
+inline __m128i AbsoluteDifference(__m128i lhs, __m128i rhs, uint16_t) noexcept
+{
+    return _mm_or_si128(_mm_subs_epu16(lhs, rhs), _mm_subs_epu16(rhs, lhs));
+}
+
+inline __m128i SubtractSaturated(__m128i lhs, __m128i rhs, uint8_t) noexcept
+{
+    return _mm_subs_epu8(lhs, rhs);
+}
+
+inline __m128i SubtractSaturated(__m128i lhs, __m128i rhs, uint16_t) noexcept
+{
+    return _mm_subs_epu16(lhs, rhs);
+}
+
+inline __m128i Broadcast(int32_t value, uint8_t) noexcept
+{
+    return _mm_set1_epi8(static_cast<char>(value));
+}
+
+inline __m128i Broadcast(int32_t value, uint16_t) noexcept
+{
+    return _mm_set1_epi16(static_cast<short>(value));
+}
+
+// Returns the index of the first byte of a sample that differs more than near, or 16 if all samples are near.
+template<typename SAMPLE>
+int32_t FindFirstNotNear(const uint8_t* values, const uint8_t* pattern, int32_t near) noexcept
+{
+    const __m128i difference = AbsoluteDifference(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values)),
+                                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern)), SAMPLE{});
+    const __m128i isNear = _mm_cmpeq_epi8(SubtractSaturated(difference, Broadcast(near, SAMPLE{}), SAMPLE{}), _mm_setzero_si128());
+    const auto mismatch = static_cast<uint32_t>(~_mm_movemask_epi8(isNear)) & 0xFFFFU;
+    return mismatch == 0 ? 16 : count_trailing_zeros(mismatch);
+}
+
+#else
+
+// NEON has no movemask: narrowing shift creates a 64 bit mask with 4 bits for every byte.
+inline int32_t FindFirstSetByte(uint8x16_t values) noexcept
+{
+    const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(values), 4)), 0);
+    return mask == 0 ? 16 : count_trailing_zeros(mask) / 4;
+}
+
+inline int32_t FindFirstMismatch(const uint8_t* values, const uint8_t* pattern) noexcept
+{
+    return FindFirstSetByte(vmvnq_u8(vceqq_u8(vld1q_u8(values), vld1q_u8(pattern))));
+}
+
+inline uint8x16_t IsGreater(const uint8_t* values, const uint8_t* pattern, int32_t near, uint8_t) noexcept
+{
+    return vcgtq_u8(vabdq_u8(vld1q_u8(values), vld1q_u8(pattern)), vdupq_n_u8(static_cast<uint8_t>(near)));
+}
+
+inline uint8x16_t IsGreater(const uint8_t* values, const uint8_t* pattern, int32_t near, uint16_t) noexcept
+{
+    const uint16x8_t difference = vabdq_u16(vreinterpretq_u16_u8(vld1q_u8(values)), vreinterpretq_u16_u8(vld1q_u8(pattern)));
+    return vreinterpretq_u8_u16(vcgtq_u16(difference, vdupq_n_u16(static_cast<uint16_t>(near))));
+}
+
+template<typename SAMPLE>
+int32_t FindFirstNotNear(const uint8_t* values, const uint8_t* pattern, int32_t near) noexcept
+{
+    return FindFirstSetByte(IsGreater(values, pattern, near, SAMPLE{}));
+}
+
+#endif
+
+// Returns the number of bytes at the start of values that are part of the run (a multiple of 16 or the index of
+// the first byte of a sample that is not within near of the pattern).
+template<typename SAMPLE>
+size_t FindRunByteCount(const uint8_t* values, size_t byteCount, const uint8_t* pattern, int32_t near) noexcept
+{
+    size_t offset = 0;
+    size_t patternOffset = 0;
+
+    if (near == 0)
+    {
+        for (; offset + 16 <= byteCount; offset += 16)
+        {
+            const int32_t mismatch = FindFirstMismatch(values + offset, pattern + patternOffset);
+            if (mismatch != 16)
+                return offset + mismatch;
+
+            patternOffset = (patternOffset + 16) % run_pattern_size;
+        }
+    }
+    else
+    {
+        for (; offset + 16 <= byteCount; offset += 16)
+        {
+            const int32_t mismatch = FindFirstNotNear<SAMPLE>(values + offset, pattern + patternOffset, near);
+            if (mismatch != 16)
+                return offset + mismatch;
+
+            patternOffset = (patternOffset + 16) % run_pattern_size;
+        }
+    }
+
+    return offset;
+}
+
+#endif
+
+#if defined(CHARLS_SSE2)
+
+// Loads 4 samples and zero extends them to 32 bit.
+inline __m128i LoadAsInt32(const uint8_t* samples) noexcept
+{
+    int32_t value;
+    std::memcpy(&value, samples, sizeof(value));
+    const __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(value), zero), zero);
+}
+
+inline __m128i LoadAsInt32(const uint16_t* samples) noexcept
+{
+    return _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(samples)), _mm_setzero_si128());
+}
+
+// SSE2 has no 32 bit min/max instructions.
+inline __m128i Minimum(__m128i lhs, __m128i rhs) noexcept
+{
+    const __m128i greater = _mm_cmpgt_epi32(lhs, rhs);
+    return _mm_or_si128(_mm_and_si128(greater, rhs), _mm_andnot_si128(greater, lhs));
+}
+
+inline __m128i Maximum(__m128i lhs, __m128i rhs) noexcept
+{
+    const __m128i greater = _mm_cmpgt_epi32(lhs, rhs);
+    return _mm_or_si128(_mm_and_si128(greater, lhs), _mm_andnot_si128(greater, rhs));
+}
+
+// Quantizes 4 gradients (lossless: NEAR == 0) by counting the thresholds they exceed, see QuantizeGradientOrg.
+// The thresholds array holds t - 1 for t = 1, T1, T2 and T3, which must be in increasing order.
+inline __m128i QuantizeGradients(__m128i gradients, const __m128i thresholds[4]) noexcept
+{
+    __m128i result = _mm_setzero_si128();
+    for (int i = 0; i < 4; ++i)
+    {
+        // cmpgt results are -1 (all bits set) when true.
+        result = _mm_sub_epi32(result, _mm_cmpgt_epi32(gradients, thresholds[i]));
+        result = _mm_add_epi32(result, _mm_cmpgt_epi32(_mm_sub_epi32(_mm_setzero_si128(), thresholds[i]), gradients));
+    }
+    return result;
+}
+
+// (q1 * 9 + q2) * 9 + q3, see ComputeContextID.
+inline __m128i ComputeContextIds(__m128i q1, __m128i q2, __m128i q3) noexcept
+{
+    const __m128i value = _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(q1, 3), q1), q2);
+    return _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(value, 3), value), q3);
+}
+
+// Median edge detector (MED) predictor: median(Ra, Rb, Ra + Rb - Rc), see GetPredictedValue.
+inline __m128i ComputePredictedValues(__m128i ra, __m128i rb, __m128i rc) noexcept
+{
+    const __m128i minimum = Minimum(ra, rb);
+    const __m128i maximum = Maximum(ra, rb);
+    return Maximum(minimum, Minimum(maximum, _mm_sub_epi32(_mm_add_epi32(ra, rb), rc)));
+}
+
+#endif
+
+
 template<typename Traits, typename Strategy>
 class JlsCodec final : public Strategy
 {
@@ -102,10 +344,11 @@ class JlsCodec final : public Strategy
     using PIXEL = typename Traits::PIXEL;
     using SAMPLE = typename Traits::SAMPLE;
 
-    JlsCodec(Traits inTraits, const JlsParameters& params) :
+    JlsCodec(Traits inTraits, const CodingParameters& params) :
         Strategy{params},
         traits{std::move(inTraits)},
-        width_{params.width}
+        width_{params.width},
+        decodingTables_{std::is_same<Strategy, DecoderStrategy>::value ? GetDecodingTables().data() : nullptr}
     {
         if (Info().interleaveMode == InterleaveMode::None)
         {
@@ -124,6 +367,7 @@ class JlsCodec final : public Strategy
     }
 
     std::unique_ptr<ProcessLine> CreateProcess(ByteStreamInfo info) override;
+    std::unique_ptr<ProcessLine> CreateTransformedProcess(ByteStreamInfo info);
 
     bool IsInterleaved() noexcept
     {
@@ -136,7 +380,7 @@ class JlsCodec final : public Strategy
         return true;
     }
 
-    JlsParameters& Info() noexcept
+    CodingParameters& Info() noexcept
     {
         return Strategy::params_;
     }
@@ -153,6 +397,7 @@ class JlsCodec final : public Strategy
 
     int32_t DecodeValue(int32_t k, int32_t limit, int32_t qbpp);
     FORCE_INLINE void EncodeMappedValue(int32_t k, int32_t mappedError, int32_t limit);
+    FORCE_INLINE void AppendZerosAndCode(int32_t zeroCount, uint32_t code, int32_t codeBitCount);
 
     void IncrementRunIndex() noexcept
     {
@@ -177,16 +422,26 @@ class JlsCodec final : public Strategy
     Quad<SAMPLE> EncodeRIPixel(Quad<SAMPLE> x, Quad<SAMPLE> Ra, Quad<SAMPLE> Rb);
     void EncodeRunPixels(int32_t runLength, bool endOfLine);
     int32_t DoRunMode(int32_t index, EncoderStrategy*);
+    int32_t FindRunLength(const PIXEL* pixels, int32_t count, PIXEL Ra) const noexcept;
 
     FORCE_INLINE SAMPLE DoRegular(int32_t Qs, int32_t, int32_t pred, DecoderStrategy*);
     FORCE_INLINE SAMPLE DoRegular(int32_t Qs, int32_t x, int32_t pred, EncoderStrategy*);
 
     void DoLine(SAMPLE* dummy);
+    int32_t DoLosslessLine(EncoderStrategy*);
+    static constexpr int32_t DoLosslessLine(DecoderStrategy*) noexcept
+    {
+        return 0;
+    }
+    bool ComputeBlockContexts(int32_t startIndex, int32_t endIndex);
     void DoLine(Triplet<SAMPLE>* dummy);
     void DoLine(Quad<SAMPLE>* dummy);
     void DoScan();
+    void InitializeScan();
+    void DoScanLine(int32_t line);
 
     void InitParams(int32_t t1, int32_t t2, int32_t t3, int32_t nReset);
+    void ResetParameters();
 
 #if defined(__clang__)
 #pragma clang diagnostic push
@@ -196,6 +451,12 @@ class JlsCodec final : public Strategy
     // Note: depending on the base class EncodeScan OR DecodeScan will be virtual and abstract, cannot use override in all cases.
     size_t EncodeScan(std::unique_ptr<ProcessLine> processLine, ByteStreamInfo& compressedData);
     void DecodeScan(std::unique_ptr<ProcessLine> processLine, const JlsRect& rect, ByteStreamInfo& compressedData);
+    void StartScan(std::unique_ptr<ProcessLine> processLine, const JlsRect& rect, ByteStreamInfo& compressedData);
+    void DecodeLine(int32_t line);
+    void FinishScan();
+    void StartEncodeScan(ByteStreamInfo& compressedData);
+    void EncodeLines(std::unique_ptr<ProcessLine> processLine, int32_t firstLine, int32_t lineCount);
+    size_t FinishEncodeScan();
 
 #if defined(__clang__)
 #pragma clang diagnostic pop
@@ -206,9 +467,11 @@ class JlsCodec final : public Strategy
     Traits traits;
     JlsRect rect_{};
     int width_;
+    const CTable* decodingTables_; // Only used (and created) when decoding.
     int32_t T1{};
     int32_t T2{};
     int32_t T3{};
+    int32_t resetValue_{};
 
     // compression context
     std::array<JlsContext, 365> contexts_;
@@ -217,9 +480,19 @@ class JlsCodec final : public Strategy
     PIXEL* previousLine_{};
     PIXEL* currentLine_{};
 
-    // quantization lookup table
-    signed char* pquant_{};
-    std::vector<signed char> rgquant_;
+    // line buffers (previous and current line of all components), kept to reuse the codec for a next scan.
+    std::vector<PIXEL, Allocator<PIXEL>> lineBuffer_;
+    std::vector<int32_t, Allocator<int32_t>> runIndexes_;
+
+    // quantization lookup table: precomputed, shared with other codecs or (with a scratch buffer) owned by the codec.
+    const signed char* pquant_{};
+    std::shared_ptr<const QuantizationLut> sharedQuant_;
+    std::vector<signed char, Allocator<signed char>> rgquant_;
+
+    // lossless encoding: context IDs and predicted values of a block of the current line, computed before the block is encoded.
+    static constexpr int32_t context_block_size = 32;
+    std::array<int32_t, context_block_size> blockContextIds_;
+    std::array<int32_t, context_block_size> blockPredictions_;
 };
 
 
@@ -233,7 +506,12 @@ typename Traits::SAMPLE JlsCodec<Traits,Strategy>::DoRegular(int32_t Qs, int32_t
     const int32_t Px = traits.CorrectPrediction(pred + ApplySign(ctx.C, sign));
 
     int32_t ErrVal;
-    const Code& code = decodingTables[k].Get(Strategy::PeekByte());
+    Code code;
+    if (static_cast<size_t>(k) < CTable::bit_count)
+    {
+        code = decodingTables_[k].Get(Strategy::PeekBits(CTable::bit_count));
+    }
+
     if (code.GetLength() != 0)
     {
         Strategy::Skip(code.GetLength());
@@ -289,11 +567,11 @@ inline CTable InitTable(int32_t k) noexcept
         // Q is not used when k != 0
         const int32_t merrval = GetMappedErrVal(nerr);
         const std::pair<int32_t, int32_t> pairCode = CreateEncodedValue(k, merrval);
-        if (static_cast<size_t>(pairCode.first) > CTable::byte_bit_count)
+        if (static_cast<size_t>(pairCode.first) > CTable::bit_count)
             break;
 
         const Code code(nerr, static_cast<short>(pairCode.first));
-        table.AddEntry(static_cast<uint8_t>(pairCode.second), code);
+        table.AddEntry(static_cast<uint32_t>(pairCode.second), code);
     }
 
     for (short nerr = -1; ; nerr--)
@@ -301,11 +579,11 @@ inline CTable InitTable(int32_t k) noexcept
         // Q is not used when k != 0
         const int32_t merrval = GetMappedErrVal(nerr);
         const std::pair<int32_t, int32_t> pairCode = CreateEncodedValue(k, merrval);
-        if (static_cast<size_t>(pairCode.first) > CTable::byte_bit_count)
+        if (static_cast<size_t>(pairCode.first) > CTable::bit_count)
             break;
 
         const Code code = Code(nerr, static_cast<short>(pairCode.first));
-        table.AddEntry(static_cast<uint8_t>(pairCode.second), code);
+        table.AddEntry(static_cast<uint32_t>(pairCode.second), code);
     }
 
     return table;
@@ -332,30 +610,36 @@ int32_t JlsCodec<Traits, Strategy>::DecodeValue(int32_t k, int32_t limit, int32_
 template<typename Traits, typename Strategy>
 FORCE_INLINE void JlsCodec<Traits, Strategy>::EncodeMappedValue(int32_t k, int32_t mappedError, int32_t limit)
 {
-    int32_t highBits = mappedError >> k;
+    const int32_t highBits = mappedError >> k;
 
+    // The Golomb code (unary prefix of zero bits, a terminating set bit and the remainder) is written with one append.
     if (highBits < limit - traits.qbpp - 1)
     {
-        if (highBits + 1 > 31)
-        {
-            Strategy::AppendToBitStream(0, highBits / 2);
-            highBits = highBits - highBits / 2;
-        }
-        Strategy::AppendToBitStream(1, highBits + 1);
-        Strategy::AppendToBitStream((mappedError & ((1 << k) - 1)), k);
+        AppendZerosAndCode(highBits, (1U << k) | zero_high_bits(static_cast<uint32_t>(mappedError), k), k + 1);
         return;
     }
 
-    if (limit - traits.qbpp > 31)
+    AppendZerosAndCode(limit - traits.qbpp - 1, (1U << traits.qbpp) | zero_high_bits(static_cast<uint32_t>(mappedError - 1), traits.qbpp), traits.qbpp + 1);
+}
+
+
+template<typename Traits, typename Strategy>
+FORCE_INLINE void JlsCodec<Traits, Strategy>::AppendZerosAndCode(int32_t zeroCount, uint32_t code, int32_t codeBitCount)
+{
+    if (zeroCount + codeBitCount <= 32)
     {
-        Strategy::AppendToBitStream(0, 31);
-        Strategy::AppendToBitStream(1, limit - traits.qbpp - 31);
+        Strategy::AppendToBitStream(code, zeroCount + codeBitCount);
+        return;
     }
-    else
+
+    // Long codes (only possible for large limit values) need to be split.
+    if (zeroCount > 32)
     {
-        Strategy::AppendToBitStream(1, limit - traits.qbpp);
+        Strategy::AppendToBitStream(0, 32);
+        zeroCount -= 32;
     }
-    Strategy::AppendToBitStream((mappedError - 1) & ((1 << traits.qbpp) - 1), traits.qbpp);
+    Strategy::AppendToBitStream(0, zeroCount);
+    Strategy::AppendToBitStream(code, codeBitCount);
 }
 
 
@@ -374,38 +658,29 @@ void JlsCodec<Traits, Strategy>::InitQuantizationLUT()
         const JpegLSPresetCodingParameters presets = ComputeDefault(traits.MAXVAL, traits.NEAR);
         if (presets.Threshold1 == T1 && presets.Threshold2 == T2 && presets.Threshold3 == T3)
         {
-            if (traits.bpp == 8)
-            {
-                pquant_ = &rgquant8Ll[rgquant8Ll.size() / 2];
-                return;
-            }
-            if (traits.bpp == 10)
-            {
-                pquant_ = &rgquant10Ll[rgquant10Ll.size() / 2];
+            pquant_ = GetLosslessQuantizationLut(traits.bpp);
+            if (pquant_)
                 return;
-            }
-            if (traits.bpp == 12)
-            {
-                pquant_ = &rgquant12Ll[rgquant12Ll.size() / 2];
-                return;
-            }
-            if (traits.bpp == 16)
-            {
-                pquant_ = &rgquant16Ll[rgquant16Ll.size() / 2];
-                return;
-            }
         }
     }
 
     const int32_t RANGE = 1 << traits.bpp;
 
-    rgquant_.resize(static_cast<size_t>(RANGE) * 2);
+    // Near-lossless coding and custom parameters: the LUT is shared by all codecs in the process, a call with a scratch buffer
+    // can't add it to the cache (the cache outlives the call) and creates its own LUT when it's not cached yet.
+    sharedQuant_ = GetQuantizationLut(traits.bpp, traits.NEAR, T1, T2, T3, !IsScratchActive());
+    if (sharedQuant_)
+    {
+        pquant_ = &(*sharedQuant_)[RANGE];
+        return;
+    }
 
-    pquant_ = &rgquant_[RANGE];
+    rgquant_.resize(static_cast<size_t>(RANGE) * 2);
     for (int32_t i = -RANGE; i < RANGE; ++i)
     {
-        pquant_[i] = QuantizeGradientOrg(i);
+        rgquant_[static_cast<size_t>(RANGE + i)] = QuantizeGradientOrg(i);
     }
+    pquant_ = &rgquant_[RANGE];
 }
 
 MSVC_WARNING_UNSUPPRESS()
@@ -579,34 +854,45 @@ template<typename Traits, typename Strategy>
 int32_t JlsCodec<Traits, Strategy>::DecodeRunPixels(PIXEL Ra, PIXEL* startPos, int32_t cpixelMac)
 {
     int32_t index = 0;
-    while (Strategy::ReadBit())
+    for (;;)
     {
-        const int count = std::min(1 << J[RUNindex_], int(cpixelMac - index));
-        index += count;
-        ASSERT(index <= cpixelMac);
+        // Every set bit is a complete run segment of 1 << J[RUNindex_] pixels: handle all set bits in the cache at once.
+        const int32_t onesCount = Strategy::PeekOnes();
+        if (onesCount == 0)
+        {
+            Strategy::Skip(1); // the 0 bit that signals an incomplete run.
+            break;
+        }
 
-        if (count == (1 << J[RUNindex_]))
+        for (int32_t i = 0; i < onesCount; ++i)
         {
-            IncrementRunIndex();
+            const int count = std::min(1 << J[RUNindex_], int(cpixelMac - index));
+            index += count;
+            ASSERT(index <= cpixelMac);
+
+            if (count == (1 << J[RUNindex_]))
+            {
+                IncrementRunIndex();
+            }
+
+            if (index == cpixelMac)
+            {
+                Strategy::Skip(i + 1);
+                FillPixels(startPos, index, Ra);
+                return index;
+            }
         }
 
-        if (index == cpixelMac)
-            break;
+        Strategy::Skip(onesCount);
     }
 
-    if (index != cpixelMac)
-    {
-        // incomplete run.
-        index += (J[RUNindex_] > 0) ? Strategy::ReadValue(J[RUNindex_]) : 0;
-    }
+    // incomplete run.
+    index += (J[RUNindex_] > 0) ? Strategy::ReadValue(J[RUNindex_]) : 0;
 
     if (index > cpixelMac)
         throw jpegls_error{jpegls_errc::invalid_encoded_data};
 
-    for (int32_t i = 0; i < index; ++i)
-    {
-        startPos[i] = Ra;
-    }
+    FillPixels(startPos, index, Ra);
 
     return index;
 }
@@ -620,15 +906,12 @@ int32_t JlsCodec<Traits, Strategy>::DoRunMode(int32_t index, EncoderStrategy*)
 
     const PIXEL Ra = ptypeCurX[-1];
 
-    int32_t runLength = 0;
+    const int32_t runLength = FindRunLength(ptypeCurX, ctypeRem, Ra);
 
-    while (traits.IsNear(ptypeCurX[runLength],Ra))
+    // In near lossless mode the decoder reconstructs the complete run with Ra.
+    if (traits.NEAR != 0)
     {
-        ptypeCurX[runLength] = Ra;
-        runLength++;
-
-        if (runLength == ctypeRem)
-            break;
+        FillPixels(ptypeCurX, runLength, Ra);
     }
 
     EncodeRunPixels(runLength, runLength == ctypeRem);
@@ -642,6 +925,35 @@ int32_t JlsCodec<Traits, Strategy>::DoRunMode(int32_t index, EncoderStrategy*)
 }
 
 
+template<typename Traits, typename Strategy>
+int32_t JlsCodec<Traits, Strategy>::FindRunLength(const PIXEL* pixels, int32_t count, PIXEL Ra) const noexcept
+{
+    int32_t runLength = 0;
+
+#if defined(CHARLS_SSE2) || defined(CHARLS_NEON)
+    static_assert(run_pattern_size % sizeof(PIXEL) == 0, "the pixel size should be a divisor of the pattern size");
+
+    uint8_t pattern[run_pattern_size];
+    for (size_t i = 0; i < run_pattern_size; i += sizeof(PIXEL))
+    {
+        std::memcpy(pattern + i, &Ra, sizeof(PIXEL));
+    }
+
+    const size_t byteCount = FindRunByteCount<SAMPLE>(reinterpret_cast<const uint8_t*>(pixels),
+                                                      static_cast<size_t>(count) * sizeof(PIXEL), pattern, traits.NEAR);
+    runLength = static_cast<int32_t>(byteCount / sizeof(PIXEL));
+#endif
+
+    // Check the remaining pixels (less than 16 bytes, or all pixels when no vector instructions are available).
+    while (runLength < count && traits.IsNear(pixels[runLength], Ra))
+    {
+        ++runLength;
+    }
+
+    return runLength;
+}
+
+
 template<typename Traits, typename Strategy>
 int32_t JlsCodec<Traits, Strategy>::DoRunMode(int32_t startIndex, DecoderStrategy*)
 {
@@ -665,7 +977,7 @@ int32_t JlsCodec<Traits, Strategy>::DoRunMode(int32_t startIndex, DecoderStrateg
 template<typename Traits, typename Strategy>
 void JlsCodec<Traits, Strategy>::DoLine(SAMPLE*)
 {
-    int32_t index = 0;
+    int32_t index = DoLosslessLine(static_cast<Strategy*>(nullptr));
     int32_t Rb = previousLine_[index-1];
     int32_t Rd = previousLine_[index];
 
@@ -693,6 +1005,110 @@ void JlsCodec<Traits, Strategy>::DoLine(SAMPLE*)
 }
 
 
+/// <summary>
+/// Encodes a scan line of single component samples in lossless mode in 2 phases per block of samples.
+/// In lossless mode encoding doesn't modify the samples, the contexts and predictions of a block can therefore
+/// be computed up front (vectorized), only the entropy coding itself is serial. Blocks covered by a run are skipped.
+/// Returns the index of the first sample that still needs to be encoded by the generic code path.
+/// </summary>
+template<typename Traits, typename Strategy>
+int32_t JlsCodec<Traits, Strategy>::DoLosslessLine(EncoderStrategy*)
+{
+    if (traits.NEAR != 0)
+        return 0;
+
+    int32_t index = 0;
+    int32_t blockStart = 0;
+    int32_t blockEnd = 0;
+    while (index < width_)
+    {
+        if (index >= blockEnd)
+        {
+            // Check for the start of a run first (in lossless mode all gradients are zero): no need to compute a block that is skipped.
+            if (currentLine_[index - 1] == previousLine_[index - 1] && previousLine_[index - 1] == previousLine_[index] &&
+                previousLine_[index] == previousLine_[index + 1])
+            {
+                index += DoRunMode(index, static_cast<Strategy*>(nullptr));
+                continue;
+            }
+
+            blockStart = index;
+            blockEnd = std::min(index + context_block_size, width_);
+            if (!ComputeBlockContexts(blockStart, blockEnd))
+                return index;
+        }
+
+        const int32_t Qs = blockContextIds_[index - blockStart];
+        if (Qs != 0)
+        {
+            DoRegular(Qs, currentLine_[index], blockPredictions_[index - blockStart], static_cast<Strategy*>(nullptr));
+            index++;
+        }
+        else
+        {
+            index += DoRunMode(index, static_cast<Strategy*>(nullptr));
+        }
+    }
+
+    return index;
+}
+
+
+/// <summary>
+/// Computes the context ID and the predicted value of the samples [startIndex, endIndex) of the current line (lossless mode only).
+/// Returns false if a sample is larger than MAXVAL: its reconstructed value would differ and change the next contexts.
+/// </summary>
+template<typename Traits, typename Strategy>
+bool JlsCodec<Traits, Strategy>::ComputeBlockContexts(const int32_t startIndex, const int32_t endIndex)
+{
+    int32_t index = startIndex;
+
+#if defined(CHARLS_SSE2)
+    if (T1 >= 1 && T1 <= T2 && T2 <= T3)
+    {
+        const __m128i thresholds[4]{_mm_setzero_si128(), _mm_set1_epi32(T1 - 1), _mm_set1_epi32(T2 - 1), _mm_set1_epi32(T3 - 1)};
+        const __m128i maximumValue = _mm_set1_epi32(traits.MAXVAL);
+        __m128i invalid = _mm_setzero_si128();
+
+        for (; index + 4 <= endIndex; index += 4)
+        {
+            const __m128i Ra = LoadAsInt32(currentLine_ + index - 1);
+            const __m128i Rc = LoadAsInt32(previousLine_ + index - 1);
+            const __m128i Rb = LoadAsInt32(previousLine_ + index);
+            const __m128i Rd = LoadAsInt32(previousLine_ + index + 1);
+
+            const __m128i Qs = ComputeContextIds(QuantizeGradients(_mm_sub_epi32(Rd, Rb), thresholds),
+                                                 QuantizeGradients(_mm_sub_epi32(Rb, Rc), thresholds),
+                                                 QuantizeGradients(_mm_sub_epi32(Rc, Ra), thresholds));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&blockContextIds_[index - startIndex]), Qs);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&blockPredictions_[index - startIndex]), ComputePredictedValues(Ra, Rb, Rc));
+
+            invalid = _mm_or_si128(invalid, _mm_cmpgt_epi32(LoadAsInt32(currentLine_ + index), maximumValue));
+        }
+
+        if (_mm_movemask_epi8(invalid) != 0)
+            return false;
+    }
+#endif
+
+    for (; index < endIndex; ++index)
+    {
+        if (currentLine_[index] > traits.MAXVAL)
+            return false;
+
+        const int32_t Ra = currentLine_[index - 1];
+        const int32_t Rc = previousLine_[index - 1];
+        const int32_t Rb = previousLine_[index];
+        const int32_t Rd = previousLine_[index + 1];
+
+        blockContextIds_[index - startIndex] = ComputeContextID(QuantizeGradient(Rd - Rb), QuantizeGradient(Rb - Rc), QuantizeGradient(Rc - Ra));
+        blockPredictions_[index - startIndex] = GetPredictedValue(Ra, Rb, Rc);
+    }
+
+    return true;
+}
+
+
 /// <summary>Encodes/Decodes a scan line of triplets in ILV_SAMPLE mode</summary>
 template<typename Traits, typename Strategy>
 void JlsCodec<Traits, Strategy>::DoLine(Triplet<SAMPLE>*)
@@ -768,45 +1184,137 @@ void JlsCodec<Traits, Strategy>::DoLine(Quad<SAMPLE>*)
 
 template<typename Traits, typename Strategy>
 void JlsCodec<Traits, Strategy>::DoScan()
+{
+    InitializeScan();
+
+    for (int32_t line = 0; line < Info().height; ++line)
+    {
+        DoScanLine(line);
+    }
+
+    Strategy::EndScan();
+}
+
+
+template<typename Traits, typename Strategy>
+void JlsCodec<Traits, Strategy>::InitializeScan()
 {
     const int32_t pixelStride = width_ + 4;
     const int components = Info().interleaveMode == InterleaveMode::Line ? Info().components : 1;
 
-    std::vector<PIXEL> vectmp(static_cast<size_t>(2) * components * pixelStride);
-    std::vector<int32_t> rgRUNindex(components);
+    lineBuffer_.assign(static_cast<size_t>(2) * components * pixelStride, PIXEL{});
+    runIndexes_.assign(components, 0);
+    ResetParameters();
+}
 
-    for (int32_t line = 0; line < Info().height; ++line)
+
+// Codes a line of the scan (all components of a line interleaved scan), the coding state is kept in the codec between lines.
+template<typename Traits, typename Strategy>
+void JlsCodec<Traits, Strategy>::DoScanLine(int32_t line)
+{
+    const int32_t pixelStride = width_ + 4;
+    const int components = Info().interleaveMode == InterleaveMode::Line ? Info().components : 1;
+
+    if (Info().restartInterval > 0 && line > 0 && line % Info().restartInterval == 0)
     {
-        previousLine_ = &vectmp[1];
-        currentLine_ = &vectmp[1 + static_cast<size_t>(components) * pixelStride];
-        if ((line & 1) == 1)
-        {
-            std::swap(previousLine_, currentLine_);
-        }
+        // A restart interval is coded as if it is the start of the scan: reset the coding state and the previous line.
+        Strategy::ProcessRestartMarker((line / Info().restartInterval - 1) % RestartMarkerRange);
+        ResetParameters();
+        std::fill(lineBuffer_.begin(), lineBuffer_.end(), PIXEL{});
+        std::fill(runIndexes_.begin(), runIndexes_.end(), 0);
+    }
 
-        Strategy::OnLineBegin(width_, currentLine_, pixelStride);
+    previousLine_ = &lineBuffer_[1];
+    currentLine_ = &lineBuffer_[1 + static_cast<size_t>(components) * pixelStride];
+    if ((line & 1) == 1)
+    {
+        std::swap(previousLine_, currentLine_);
+    }
 
-        for (int component = 0; component < components; ++component)
-        {
-            RUNindex_ = rgRUNindex[component];
+    Strategy::OnLineBegin(width_, currentLine_, pixelStride);
 
-            // initialize edge pixels used for prediction
-            previousLine_[width_] = previousLine_[width_ - 1];
-            currentLine_[-1] = previousLine_[0];
-            DoLine(static_cast<PIXEL*>(nullptr)); // dummy argument for overload resolution
+    for (int component = 0; component < components; ++component)
+    {
+        RUNindex_ = runIndexes_[component];
+
+        // initialize edge pixels used for prediction
+        previousLine_[width_] = previousLine_[width_ - 1];
+        currentLine_[-1] = previousLine_[0];
+        DoLine(static_cast<PIXEL*>(nullptr)); // dummy argument for overload resolution
+
+        runIndexes_[component] = RUNindex_;
+        previousLine_ += pixelStride;
+        currentLine_ += pixelStride;
+    }
+
+    if (rect_.Y <= line && line < rect_.Y + rect_.Height)
+    {
+        Strategy::OnLineEnd(rect_.Width, currentLine_ + rect_.X - (static_cast<size_t>(components) * pixelStride), pixelStride);
+    }
+}
+
+
+// Incremental decoding: the scan is decoded line by line, the caller ensures that the encoded data of a line is available.
+template<typename Traits, typename Strategy>
+void JlsCodec<Traits, Strategy>::StartScan(std::unique_ptr<ProcessLine> processLine, const JlsRect& rect, ByteStreamInfo& compressedData)
+{
+    Strategy::processLine_ = std::move(processLine);
+    rect_ = rect;
+    Strategy::Init(compressedData);
+    InitializeScan();
+}
+
+
+template<typename Traits, typename Strategy>
+void JlsCodec<Traits, Strategy>::DecodeLine(int32_t line)
+{
+    DoScanLine(line);
+}
+
+
+template<typename Traits, typename Strategy>
+void JlsCodec<Traits, Strategy>::FinishScan()
+{
+    Strategy::EndScan();
+    Strategy::processLine_->Flush();
+}
+
+
+// Incremental encoding: the lines are encoded when they are pushed, the source of the pushed lines is only used during the call.
+template<typename Traits, typename Strategy>
+void JlsCodec<Traits, Strategy>::StartEncodeScan(ByteStreamInfo& compressedData)
+{
+    Strategy::Init(compressedData);
+    InitializeScan();
+}
 
-            rgRUNindex[component] = RUNindex_;
-            previousLine_ += pixelStride;
-            currentLine_ += pixelStride;
-        }
 
-        if (rect_.Y <= line && line < rect_.Y + rect_.Height)
+template<typename Traits, typename Strategy>
+void JlsCodec<Traits, Strategy>::EncodeLines(std::unique_ptr<ProcessLine> processLine, int32_t firstLine, int32_t lineCount)
+{
+    Strategy::processLine_ = std::move(processLine);
+    try
+    {
+        for (int32_t line = firstLine; line < firstLine + lineCount; ++line)
         {
-            Strategy::OnLineEnd(rect_.Width, currentLine_ + rect_.X - (static_cast<size_t>(components) * pixelStride), pixelStride);
+            DoScanLine(line);
         }
     }
+    catch (...)
+    {
+        Strategy::processLine_.reset();
+        throw;
+    }
+    Strategy::processLine_->Flush();
+    Strategy::processLine_.reset();
+}
+
 
+template<typename Traits, typename Strategy>
+size_t JlsCodec<Traits, Strategy>::FinishEncodeScan()
+{
     Strategy::EndScan();
+    return Strategy::GetLength();
 }
 
 
@@ -821,6 +1329,23 @@ std::unique_ptr<ProcessLine> JlsCodec<Traits, Strategy>::CreateProcess(ByteStrea
             std::unique_ptr<ProcessLine>(std::make_unique<PostProcessSingleStream>(info.rawStream, Info(), sizeof(typename Traits::PIXEL)));
     }
 
+    std::unique_ptr<ProcessLine> processLine = CreateTransformedProcess(info);
+
+    // Stream I/O, color transforms, BGR swaps and (de)interleaving are worth a second thread, a plain copy of sample interleaved pixels is not.
+    if (Info().threadCount > 1 &&
+        (info.rawStream || Info().colorTransformation != ColorTransformation::None || Info().outputBgr || Info().interleaveMode == InterleaveMode::Line))
+    {
+        const int32_t rowCount = Info().interleaveMode == InterleaveMode::Line ? Info().components : 1;
+        return std::make_unique<PipelinedProcessLine>(std::move(processLine), rowCount, sizeof(PIXEL), Info().height);
+    }
+
+    return processLine;
+}
+
+
+template<typename Traits, typename Strategy>
+std::unique_ptr<ProcessLine> JlsCodec<Traits, Strategy>::CreateTransformedProcess(ByteStreamInfo info)
+{
     if (Info().colorTransformation == ColorTransformation::None)
         return std::make_unique<ProcessTransformed<TransformNone<typename Traits::SAMPLE>>>(info, Info(), TransformNone<SAMPLE>());
 
@@ -861,13 +1386,23 @@ size_t JlsCodec<Traits, Strategy>::EncodeScan(std::unique_ptr<ProcessLine> proce
     Strategy::processLine_ = std::move(processLine);
 
     Strategy::Init(compressedData);
-    DoScan();
+    try
+    {
+        DoScan();
+    }
+    catch (...)
+    {
+        // Stops and joins the thread that prepares lines ahead: the source is no longer used when the call fails.
+        Strategy::processLine_.reset();
+        throw;
+    }
+    Strategy::processLine_->Flush();
 
     return Strategy::GetLength();
 }
 
 
-// Setup codec for decoding and calls DoScan
+// Setup codec for decoding and decodes the lines of the scan up to the last line of the region of interest
 template<typename Traits, typename Strategy>
 void JlsCodec<Traits, Strategy>::DecodeScan(std::unique_ptr<ProcessLine> processLine, const JlsRect& rect, ByteStreamInfo& compressedData)
 {
@@ -877,7 +1412,33 @@ void JlsCodec<Traits, Strategy>::DecodeScan(std::unique_ptr<ProcessLine> process
     rect_ = rect;
 
     Strategy::Init(compressedData);
-    DoScan();
+    try
+    {
+        // Decoding stops after the last line of the region of interest, the encoded data of the lines below it is skipped.
+        const int32_t lineCount = std::min(rect_.Y + rect_.Height, Info().height);
+        InitializeScan();
+        for (int32_t line = 0; line < lineCount; ++line)
+        {
+            DoScanLine(line);
+        }
+
+        if (lineCount < Info().height)
+        {
+            Strategy::SkipToEndOfScan();
+        }
+        else
+        {
+            Strategy::EndScan();
+        }
+    }
+    catch (...)
+    {
+        // Lines decoded before the error are processed first: their errors are reported as with synchronous processing.
+        Strategy::processLine_->Flush();
+        throw;
+    }
+    Strategy::processLine_->Flush();
+    Strategy::SeekToEndOfScan();
     SkipBytes(compressedData, Strategy::GetCurBytePos() - compressedBytes);
 }
 MSVC_WARNING_UNSUPPRESS()
@@ -890,16 +1451,24 @@ void JlsCodec<Traits, Strategy>::InitParams(int32_t t1, int32_t t2, int32_t t3,
     T2 = t2;
     T3 = t3;
 
+    resetValue_ = nReset;
+
     InitQuantizationLUT();
+}
+
 
+// Sets the context variables to their initial values, required at the start of a scan and of every restart interval.
+template<typename Traits, typename Strategy>
+void JlsCodec<Traits, Strategy>::ResetParameters()
+{
     const JlsContext contextInitValue(std::max(2, (traits.RANGE + 32) / 64));
     for (auto& context : contexts_)
     {
         context = contextInitValue;
     }
 
-    contextRunmode_[0] = CContextRunMode(std::max(2, (traits.RANGE + 32) / 64), 0, nReset);
-    contextRunmode_[1] = CContextRunMode(std::max(2, (traits.RANGE + 32) / 64), 1, nReset);
+    contextRunmode_[0] = CContextRunMode(std::max(2, (traits.RANGE + 32) / 64), 0, resetValue_);
+    contextRunmode_[1] = CContextRunMode(std::max(2, (traits.RANGE + 32) / 64), 1, resetValue_);
     RUNindex_ = 0;
 }
 
@@ -24,6 +24,15 @@
 #  endif
 #endif
 
+// SSE2 is always available on x64 and NEON on ARM64, use these instruction sets for the few vectorized code paths.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define CHARLS_SSE2
+#  include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#  define CHARLS_NEON
+#  include <arm_neon.h>
+#endif
+
 #ifdef _MSC_VER
 #define MSVC_WARNING_SUPPRESS(x) __pragma(warning(push)) __pragma(warning(disable : x))  // NOLINT(misc-macro-parentheses, bugprone-macro-parentheses)
 #define MSVC_WARNING_UNSUPPRESS() __pragma(warning(pop))
@@ -38,24 +47,14 @@ namespace charls
 constexpr size_t int32_t_bit_count = sizeof(int32_t) * 8;
 
 
-inline void push_back(std::vector<uint8_t>& values, uint16_t value)
+template<typename Alloc>
+void push_back(std::vector<uint8_t, Alloc>& values, uint16_t value)
 {
     values.push_back(uint8_t(value / 0x100));
     values.push_back(uint8_t(value % 0x100));
 }
 
 
-constexpr int32_t log_2(int32_t n) noexcept
-{
-    int32_t x = 0;
-    while (n > (1 << x))
-    {
-        ++x;
-    }
-    return x;
-}
-
-
 constexpr int32_t Sign(int32_t n) noexcept
 {
     return (n >> (int32_t_bit_count - 1)) | 1;
@@ -101,13 +100,15 @@ struct Triplet
 };
 
 
-inline bool operator==(const Triplet<uint8_t>& lhs, const Triplet<uint8_t>& rhs) noexcept
+template<typename sample>
+bool operator==(const Triplet<sample>& lhs, const Triplet<sample>& rhs) noexcept
 {
     return lhs.v1 == rhs.v1 && lhs.v2 == rhs.v2 && lhs.v3 == rhs.v3;
 }
 
 
-inline bool operator!=(const Triplet<uint8_t>& lhs, const Triplet<uint8_t>& rhs) noexcept
+template<typename sample>
+bool operator!=(const Triplet<sample>& lhs, const Triplet<sample>& rhs) noexcept
 {
     return !(lhs == rhs);
 }
@@ -140,6 +141,20 @@ struct Quad final : Triplet<sample>
 };
 
 
+template<typename sample>
+bool operator==(const Quad<sample>& lhs, const Quad<sample>& rhs) noexcept
+{
+    return lhs.v1 == rhs.v1 && lhs.v2 == rhs.v2 && lhs.v3 == rhs.v3 && lhs.v4 == rhs.v4;
+}
+
+
+template<typename sample>
+bool operator!=(const Quad<sample>& lhs, const Quad<sample>& rhs) noexcept
+{
+    return !(lhs == rhs);
+}
+
+
 template<int size>
 struct FromBigEndian final
 {
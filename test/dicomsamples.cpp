@@ -3,6 +3,7 @@
 #include "dicomsamples.h"
 #include "util.h"
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <array>
@@ -47,6 +48,14 @@ void TestDicomSampleImage(const char* name)
 
     data.erase(data.begin(), data.begin() + offset - 4);
 
+    // The fragments (64k, after an 8 byte item header) can also be decoded in place.
+    const vector<uint8_t> fragmentedData{data};
+    vector<charls_buffer_fragment> fragments;
+    for (size_t i = 8; i < fragmentedData.size(); i += 64 * 1024 + 8)
+    {
+        fragments.push_back({&fragmentedData[i], std::min(static_cast<size_t>(64 * 1024), fragmentedData.size() - i)});
+    }
+
     // remove the DICOM fragment headers (in the concerned images they occur every 64k)
     for (unsigned int i =  0; i < data.size(); i+= 64 * 1024)
     {
@@ -62,6 +71,13 @@ void TestDicomSampleImage(const char* name)
 
     error = JpegLsDecode(dataUnc.data(), dataUnc.size(), data.data(), data.size(), nullptr, nullptr);
     Assert::IsTrue(!error);
+
+    charls_jpegls_decoder* decoder = charls_jpegls_decoder_create();
+    vector<uint8_t> fragmentsUnc(dataUnc.size());
+    error = charls_jpegls_decoder_decode_fragments(decoder, fragmentsUnc.data(), fragmentsUnc.size(), fragments.data(), fragments.size(), nullptr);
+    charls_jpegls_decoder_destroy(decoder);
+    Assert::IsTrue(!error);
+    Assert::IsTrue(fragmentsUnc == dataUnc);
     cout << ".";
 }
 
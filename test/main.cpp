@@ -4,6 +4,7 @@
 
 #include "../src/default_traits.h"
 #include "../src/lossless_traits.h"
+#include "../src/near_lossless_traits.h"
 #include "../src/process_line.h"
 
 #include "bitstreamdamage.h"
@@ -16,7 +17,11 @@
 #include <vector>
 #include <algorithm>
 #include <array>
+#include <cstdlib>
 #include <string>
+#include <thread>
+#include <chrono>
+#include <memory>
 
 using std::cin;
 using std::cout;
@@ -36,9 +41,13 @@ using std::iter_swap;
 using std::getline;
 using charls::DefaultTraits;
 using charls::LosslessTraits;
+using charls::NearLosslessTraits;
+using charls::Triplet;
+using charls::Quad;
 using charls::jpegls_errc;
 using charls::TransformRgbToBgr;
 using charls::InterleaveMode;
+using charls::ColorTransformation;
 using charls::log_2;
 
 
@@ -116,6 +125,72 @@ void TestTraits8bit()
 }
 
 
+void TestTraitsColor()
+{
+    const auto traits1 = DefaultTraits<uint16_t, Triplet<uint16_t>>(4095, 0);
+    const auto traits2 = LosslessTraits<Triplet<uint16_t>, 12>();
+    const auto traits3 = DefaultTraits<uint16_t, Quad<uint16_t>>(1023, 0);
+    const auto traits4 = LosslessTraits<Quad<uint16_t>, 10>();
+
+    Assert::IsTrue(traits1.LIMIT == traits2.LIMIT);
+    Assert::IsTrue(traits3.LIMIT == traits4.LIMIT);
+
+    // The sample type is wider than bpp: the reconstructed sample must wrap around within the range.
+    for (int px = 0; px < 4096; px += 3)
+    {
+        for (int errorValue = -2048; errorValue < 2048; errorValue += 5)
+        {
+            Assert::IsTrue(traits1.ComputeReconstructedSample(px, errorValue) == traits2.ComputeReconstructedSample(px, errorValue));
+        }
+    }
+
+    for (int px = 0; px < 1024; ++px)
+    {
+        for (int errorValue = -512; errorValue < 512; ++errorValue)
+        {
+            Assert::IsTrue(traits3.ComputeReconstructedSample(px, errorValue) == traits4.ComputeReconstructedSample(px, errorValue));
+        }
+    }
+}
+
+
+template<int32_t near>
+void TestTraitsNearLossless(int32_t maximumValue)
+{
+    const auto traits1 = DefaultTraits<uint16_t, uint16_t>(maximumValue, near);
+    const auto traits2 = NearLosslessTraits<uint16_t, uint16_t, near>(maximumValue);
+
+    Assert::IsTrue(traits1.LIMIT == traits2.LIMIT);
+    Assert::IsTrue(traits1.MAXVAL == traits2.MAXVAL);
+    Assert::IsTrue(traits1.RANGE == traits2.RANGE);
+    Assert::IsTrue(traits1.RESET == traits2.RESET);
+    Assert::IsTrue(traits1.bpp == traits2.bpp);
+    Assert::IsTrue(traits1.qbpp == traits2.qbpp);
+
+    for (int i = -maximumValue; i <= maximumValue; ++i)
+    {
+        Assert::IsTrue(traits1.ComputeErrVal(i) == traits2.ComputeErrVal(i));
+        Assert::IsTrue(traits1.IsNear(i, 2) == traits2.IsNear(i, 2));
+    }
+
+    for (int px = 0; px <= maximumValue; ++px)
+    {
+        for (int errorValue = -traits1.RANGE / 2; errorValue < (traits1.RANGE + 1) / 2; ++errorValue)
+        {
+            Assert::IsTrue(traits1.ComputeReconstructedSample(px, errorValue) == traits2.ComputeReconstructedSample(px, errorValue));
+        }
+    }
+}
+
+
+void TestTraitsNearLossless()
+{
+    TestTraitsNearLossless<1>(255);
+    TestTraitsNearLossless<2>(1023);
+    TestTraitsNearLossless<3>(4095);
+}
+
+
 vector<uint8_t> MakeSomeNoise(size_t length, size_t bitCount, int seed)
 {
     srand(seed);
@@ -147,6 +222,25 @@ vector<uint8_t> MakeSomeNoise16bit(size_t length, int bitCount, int seed)
 }
 
 
+// Encodes with an encoder handle: the restart interval and the thread count are options of the handle.
+error_code EncodeWithRestartInterval(vector<uint8_t>& destination, size_t& bytesWritten, const vector<uint8_t>& source, const JlsParameters& params,
+                                     int32_t restartInterval, int32_t threadCount = 0)
+{
+    charls_jpegls_encoder* encoder = charls_jpegls_encoder_create();
+    error_code error = charls_jpegls_encoder_set_restart_interval(encoder, restartInterval);
+    if (!error)
+    {
+        error = charls_jpegls_encoder_set_thread_count(encoder, threadCount);
+    }
+    if (!error)
+    {
+        error = charls_jpegls_encoder_encode(encoder, destination.data(), destination.size(), &bytesWritten, source.data(), source.size(), &params);
+    }
+    charls_jpegls_encoder_destroy(encoder);
+    return error;
+}
+
+
 void TestNoiseImage()
 {
     const Size size2 = Size(512, 512);
@@ -189,6 +283,1036 @@ void TestNoiseImageWithCustomReset()
 }
 
 
+void TestRunModeWithChangingAlpha()
+{
+    // Runs of equal RGB values with a different alpha value should end the run (requires comparing all 4 samples).
+    const Size size{256, 40};
+    vector<uint8_t> pixels(size.cx * size.cy * 4);
+    for (size_t i = 0; i < pixels.size(); i += 4)
+    {
+        pixels[i] = 10;
+        pixels[i + 1] = 20;
+        pixels[i + 2] = 30;
+        pixels[i + 3] = static_cast<uint8_t>((i / 4) % 37 == 0 ? 255 : 0);
+    }
+
+    JlsParameters params{};
+    params.components = 4;
+    params.bitsPerSample = 8;
+    params.height = static_cast<int>(size.cy);
+    params.width = static_cast<int>(size.cx);
+    params.interleaveMode = InterleaveMode::Sample;
+
+    vector<uint8_t> encodedBuffer(pixels.size() * 2);
+    size_t compressedLength;
+    error_code error = JpegLsEncode(encodedBuffer.data(), encodedBuffer.size(), &compressedLength, pixels.data(), pixels.size(), &params, nullptr);
+    Assert::IsTrue(!error);
+
+    vector<uint8_t> decodedBuffer(pixels.size());
+    error = JpegLsDecode(decodedBuffer.data(), decodedBuffer.size(), encodedBuffer.data(), compressedLength, nullptr, nullptr);
+    Assert::IsTrue(!error);
+    Assert::IsTrue(decodedBuffer == pixels);
+}
+
+
+void TestParallelEncodeNoneInterleaved()
+{
+    // Component scans encoded concurrently should be identical to sequentially encoded scans.
+    const Size size{512, 256};
+    const int componentCount = 4;
+    const vector<uint8_t> pixels = MakeSomeNoise(size.cx * size.cy * componentCount, 7, 21344);
+
+    JlsParameters params{};
+    params.components = componentCount;
+    params.bitsPerSample = 8;
+    params.height = static_cast<int>(size.cy);
+    params.width = static_cast<int>(size.cx);
+    params.interleaveMode = InterleaveMode::None;
+
+    vector<uint8_t> sequentialBuffer(pixels.size() * 2);
+    size_t sequentialLength;
+    error_code error = JpegLsEncode(sequentialBuffer.data(), sequentialBuffer.size(), &sequentialLength, pixels.data(), pixels.size(), &params, nullptr);
+    Assert::IsTrue(!error);
+    sequentialBuffer.resize(sequentialLength);
+
+    charls_jpegls_encoder* encoder = charls_jpegls_encoder_create();
+    Assert::IsTrue(charls_jpegls_encoder_set_thread_count(encoder, -1) == jpegls_errc::invalid_argument);
+    Assert::IsTrue(charls_jpegls_encoder_set_thread_count(encoder, 3) == jpegls_errc::success);
+    vector<uint8_t> parallelBuffer(pixels.size() * 2);
+    size_t parallelLength;
+    error = charls_jpegls_encoder_encode(encoder, parallelBuffer.data(), parallelBuffer.size(), &parallelLength, pixels.data(), pixels.size(), &params);
+    Assert::IsTrue(!error);
+    parallelBuffer.resize(parallelLength);
+    Assert::IsTrue(parallelBuffer == sequentialBuffer);
+
+    // A too small destination buffer should be reported, identical to sequential encoding.
+    vector<uint8_t> smallBuffer(sequentialLength - 1);
+    error = charls_jpegls_encoder_encode(encoder, smallBuffer.data(), smallBuffer.size(), &parallelLength, pixels.data(), pixels.size(), &params);
+    Assert::IsTrue(error == jpegls_errc::destination_buffer_too_small);
+    charls_jpegls_encoder_destroy(encoder);
+}
+
+
+void TestParallelDecodeNoneInterleaved()
+{
+    const Size size{512, 256};
+    const int componentCount = 4;
+    const vector<uint8_t> pixels = MakeSomeNoise(size.cx * size.cy * componentCount, 7, 21344);
+
+    JlsParameters params{};
+    params.components = componentCount;
+    params.bitsPerSample = 8;
+    params.height = static_cast<int>(size.cy);
+    params.width = static_cast<int>(size.cx);
+    params.interleaveMode = InterleaveMode::None;
+
+    vector<uint8_t> encodedBuffer(pixels.size() * 2);
+    size_t compressedLength;
+    error_code error = JpegLsEncode(encodedBuffer.data(), encodedBuffer.size(), &compressedLength, pixels.data(), pixels.size(), &params, nullptr);
+    Assert::IsTrue(!error);
+
+    JlsParameters decodeParams{};
+    error = JpegLsReadHeader(encodedBuffer.data(), compressedLength, &decodeParams, nullptr);
+    Assert::IsTrue(!error);
+
+    charls_jpegls_decoder* decoder = charls_jpegls_decoder_create();
+    Assert::IsTrue(charls_jpegls_decoder_set_thread_count(decoder, 3) == jpegls_errc::success);
+    vector<uint8_t> decodedBuffer(pixels.size());
+    error = charls_jpegls_decoder_decode(decoder, decodedBuffer.data(), decodedBuffer.size(), encodedBuffer.data(), compressedLength, &decodeParams);
+    Assert::IsTrue(!error);
+    Assert::IsTrue(decodedBuffer == pixels);
+
+    // Corrupt encoded data of a component that is not the first should be reported as with sequential decoding.
+    const size_t corruptPosition = compressedLength * 3 / 4;
+    std::fill(encodedBuffer.begin() + corruptPosition, encodedBuffer.begin() + corruptPosition + 16, static_cast<uint8_t>(0));
+    error = JpegLsDecode(decodedBuffer.data(), decodedBuffer.size(), encodedBuffer.data(), compressedLength, nullptr, nullptr);
+    const error_code parallelError = charls_jpegls_decoder_decode(decoder, decodedBuffer.data(), decodedBuffer.size(), encodedBuffer.data(), compressedLength, nullptr);
+    Assert::IsTrue(parallelError == error);
+    charls_jpegls_decoder_destroy(decoder);
+}
+
+
+void TestRestartInterval()
+{
+    const Size size{256, 100};
+    const int componentCount = 3;
+    const vector<uint8_t> pixels = MakeSomeNoise(size.cx * size.cy * componentCount, 7, 21344);
+
+    JlsParameters params{};
+    params.components = componentCount;
+    params.bitsPerSample = 8;
+    params.height = static_cast<int>(size.cy);
+    params.width = static_cast<int>(size.cx);
+    params.interleaveMode = InterleaveMode::Sample;
+
+    vector<uint8_t> sequentialBuffer(pixels.size() * 2);
+    size_t sequentialLength;
+    error_code error = EncodeWithRestartInterval(sequentialBuffer, sequentialLength, pixels, params, 16);
+    Assert::IsTrue(!error);
+    sequentialBuffer.resize(sequentialLength);
+
+    // 100 lines in intervals of 16 lines: RST0..RST5, the last restart marker is RST5.
+    const uint8_t lastRestartMarker[] = {0xFF, 0xD5};
+    Assert::IsTrue(std::search(sequentialBuffer.begin(), sequentialBuffer.end(), std::begin(lastRestartMarker), std::end(lastRestartMarker)) != sequentialBuffer.end());
+
+    // Intervals encoded concurrently should be identical to sequentially encoded intervals.
+    vector<uint8_t> parallelBuffer(pixels.size() * 2);
+    size_t parallelLength;
+    error = EncodeWithRestartInterval(parallelBuffer, parallelLength, pixels, params, 16, 3);
+    Assert::IsTrue(!error);
+    parallelBuffer.resize(parallelLength);
+    Assert::IsTrue(parallelBuffer == sequentialBuffer);
+
+    vector<uint8_t> decodedBuffer(pixels.size());
+    error = JpegLsDecode(decodedBuffer.data(), decodedBuffer.size(), sequentialBuffer.data(), sequentialBuffer.size(), nullptr, nullptr);
+    Assert::IsTrue(!error);
+    Assert::IsTrue(decodedBuffer == pixels);
+
+    charls_jpegls_decoder* decoder = charls_jpegls_decoder_create();
+    Assert::IsTrue(charls_jpegls_decoder_set_thread_count(decoder, 3) == jpegls_errc::success);
+    std::fill(decodedBuffer.begin(), decodedBuffer.end(), static_cast<uint8_t>(0));
+    error = charls_jpegls_decoder_decode(decoder, decodedBuffer.data(), decodedBuffer.size(), sequentialBuffer.data(), sequentialBuffer.size(), nullptr);
+    charls_jpegls_decoder_destroy(decoder);
+    Assert::IsTrue(!error);
+    Assert::IsTrue(decodedBuffer == pixels);
+
+    charls_jpegls_encoder* encoder = charls_jpegls_encoder_create();
+    Assert::IsTrue(charls_jpegls_encoder_set_restart_interval(encoder, -1) == jpegls_errc::invalid_argument_restart_interval);
+    Assert::IsTrue(charls_jpegls_encoder_set_restart_interval(encoder, 65536) == jpegls_errc::invalid_argument_restart_interval);
+    charls_jpegls_encoder_destroy(encoder);
+}
+
+
+void TestPipelinedDecode()
+{
+    // Color transformed line interleaved images are post-processed on a second thread when a thread count is set.
+    const Size size{300, 200};
+    const int componentCount = 3;
+    const vector<uint8_t> pixels = MakeSomeNoise(size.cx * size.cy * componentCount, 8, 21344);
+
+    JlsParameters params{};
+    params.components = componentCount;
+    params.bitsPerSample = 8;
+    params.height = static_cast<int>(size.cy);
+    params.width = static_cast<int>(size.cx);
+    params.interleaveMode = InterleaveMode::Line;
+    params.colorTransformation = ColorTransformation::HP1;
+
+    vector<uint8_t> encodedBuffer(pixels.size() * 2);
+    size_t compressedLength;
+    error_code error = JpegLsEncode(encodedBuffer.data(), encodedBuffer.size(), &compressedLength, pixels.data(), pixels.size(), &params, nullptr);
+    Assert::IsTrue(!error);
+
+    charls_jpegls_decoder* decoder = charls_jpegls_decoder_create();
+    Assert::IsTrue(charls_jpegls_decoder_set_thread_count(decoder, 2) == jpegls_errc::success);
+    JlsParameters decodeParams{};
+    vector<uint8_t> decodedBuffer(pixels.size());
+    error = charls_jpegls_decoder_decode(decoder, decodedBuffer.data(), decodedBuffer.size(), encodedBuffer.data(), compressedLength, &decodeParams);
+    Assert::IsTrue(!error);
+    Assert::IsTrue(decodedBuffer == pixels);
+
+    decodeParams.outputBgr = static_cast<char>(true);
+    vector<uint8_t> pipelinedBuffer(pixels.size());
+    error = charls_jpegls_decoder_decode(decoder, pipelinedBuffer.data(), pipelinedBuffer.size(), encodedBuffer.data(), compressedLength, &decodeParams);
+    Assert::IsTrue(!error);
+    error = JpegLsDecode(decodedBuffer.data(), decodedBuffer.size(), encodedBuffer.data(), compressedLength, &decodeParams, nullptr);
+    Assert::IsTrue(!error);
+    Assert::IsTrue(decodedBuffer == pipelinedBuffer);
+
+    // Errors of the post-processing thread (a too small destination stream) are reported.
+    struct FixedSizeStreamBuffer final : std::basic_streambuf<char>
+    {
+        FixedSizeStreamBuffer(char* buffer, size_t size)
+        {
+            setp(buffer, buffer + size);
+        }
+    };
+
+    vector<char> smallBuffer(pixels.size() / 2);
+    FixedSizeStreamBuffer smallStream(smallBuffer.data(), smallBuffer.size());
+    error = charls_jpegls_decoder_decode_stream(decoder, {&smallStream, nullptr, 0}, FromByteArray(encodedBuffer.data(), compressedLength), &decodeParams);
+    Assert::IsTrue(error == jpegls_errc::destination_buffer_too_small);
+    charls_jpegls_decoder_destroy(decoder);
+}
+
+
+void TestPipelinedEncode()
+{
+    // Lines read from a stream and color transformed on a second thread should be encoded identical to synchronous processing.
+    const Size size{300, 200};
+    const int componentCount = 3;
+    const vector<uint8_t> pixels = MakeSomeNoise(size.cx * size.cy * componentCount, 8, 21344);
+
+    JlsParameters params{};
+    params.components = componentCount;
+    params.bitsPerSample = 8;
+    params.height = static_cast<int>(size.cy);
+    params.width = static_cast<int>(size.cx);
+    params.interleaveMode = InterleaveMode::Sample;
+    params.colorTransformation = ColorTransformation::HP2;
+
+    vector<uint8_t> sequentialBuffer(pixels.size() * 2);
+    size_t sequentialLength;
+    error_code error = JpegLsEncode(sequentialBuffer.data(), sequentialBuffer.size(), &sequentialLength, pixels.data(), pixels.size(), &params, nullptr);
+    Assert::IsTrue(!error);
+    sequentialBuffer.resize(sequentialLength);
+
+    charls_jpegls_encoder* encoder = charls_jpegls_encoder_create();
+    Assert::IsTrue(charls_jpegls_encoder_set_thread_count(encoder, 2) == jpegls_errc::success);
+    std::basic_stringbuf<char> sourceStream(string(pixels.begin(), pixels.end()), ios::in);
+    vector<uint8_t> pipelinedBuffer(pixels.size() * 2);
+    size_t pipelinedLength;
+    error = charls_jpegls_encoder_encode_stream(encoder, FromByteArray(pipelinedBuffer.data(), pipelinedBuffer.size()), pipelinedLength, {&sourceStream, nullptr, 0}, params);
+    Assert::IsTrue(!error);
+    pipelinedBuffer.resize(pipelinedLength);
+    Assert::IsTrue(pipelinedBuffer == sequentialBuffer);
+
+    // Errors of the thread that prepares the lines (a too small source stream) are reported.
+    std::basic_stringbuf<char> smallSourceStream(string(pixels.begin(), pixels.begin() + pixels.size() / 2), ios::in);
+    error = charls_jpegls_encoder_encode_stream(encoder, FromByteArray(pipelinedBuffer.data(), pipelinedBuffer.size()), pipelinedLength, {&smallSourceStream, nullptr, 0}, params);
+    Assert::IsTrue(error == jpegls_errc::source_buffer_too_small);
+
+    // A failed encode (too small destination) stops the thread that prepares the lines before it returns: the source can be freed.
+    // Reading the freed source is detected by memory checkers.
+    params.width = 1024;
+    params.height = 1024;
+    params.colorTransformation = ColorTransformation::HP1;
+    auto largeSource = std::make_unique<vector<uint8_t>>(MakeSomeNoise(static_cast<size_t>(params.width) * params.height * componentCount, 8, 21344));
+    array<uint8_t, 100> smallDestination{};
+    error = charls_jpegls_encoder_encode(encoder, smallDestination.data(), smallDestination.size(), &pipelinedLength, largeSource->data(), largeSource->size(),
+                                         &params);
+    Assert::IsTrue(error == jpegls_errc::destination_buffer_too_small);
+    largeSource.reset();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    charls_jpegls_encoder_destroy(encoder);
+}
+
+
+void TestEncoderDecoderHandles()
+{
+    // Handles reused for multiple images (same and different parameters) should give the same results as the one shot functions.
+    charls_jpegls_encoder* encoder = charls_jpegls_encoder_create();
+    charls_jpegls_decoder* decoder = charls_jpegls_decoder_create();
+    Assert::IsTrue(encoder && decoder);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        JlsParameters params{};
+        params.components = 3;
+        params.bitsPerSample = i == 2 ? 12 : 8;
+        params.height = 64;
+        params.width = 64;
+        params.interleaveMode = i == 3 ? InterleaveMode::None : InterleaveMode::Sample;
+        params.allowedLossyError = i == 1 ? 2 : 0;
+        const vector<uint8_t> pixels = MakeSomeNoise(params.width * params.height * params.components * (params.bitsPerSample > 8 ? 2 : 1), 4, i);
+
+        vector<uint8_t> expectedBuffer(pixels.size() * 2);
+        size_t expectedLength;
+        error_code error = JpegLsEncode(expectedBuffer.data(), expectedBuffer.size(), &expectedLength, pixels.data(), pixels.size(), &params, nullptr);
+        Assert::IsTrue(!error);
+        expectedBuffer.resize(expectedLength);
+
+        for (int repeat = 0; repeat < 2; ++repeat)
+        {
+            vector<uint8_t> encodedBuffer(pixels.size() * 2);
+            size_t encodedLength;
+            error = charls_jpegls_encoder_encode(encoder, encodedBuffer.data(), encodedBuffer.size(), &encodedLength, pixels.data(), pixels.size(), &params);
+            Assert::IsTrue(!error);
+            encodedBuffer.resize(encodedLength);
+            Assert::IsTrue(encodedBuffer == expectedBuffer);
+
+            vector<uint8_t> decodedBuffer(pixels.size());
+            error = charls_jpegls_decoder_decode(decoder, decodedBuffer.data(), decodedBuffer.size(), encodedBuffer.data(), encodedBuffer.size(), nullptr);
+            Assert::IsTrue(!error);
+            if (params.allowedLossyError == 0)
+            {
+                Assert::IsTrue(decodedBuffer == pixels);
+            }
+        }
+    }
+
+    charls_jpegls_encoder_destroy(encoder);
+    charls_jpegls_decoder_destroy(decoder);
+}
+
+
+void TestDecoderReadHeaderOnce()
+{
+    const Size size{100, 60};
+    const int componentCount = 3;
+    const vector<uint8_t> pixels = MakeSomeNoise(size.cx * size.cy * componentCount, 8, 21344);
+
+    JlsParameters params{};
+    params.components = componentCount;
+    params.bitsPerSample = 8;
+    params.height = static_cast<int>(size.cy);
+    params.width = static_cast<int>(size.cx);
+    params.interleaveMode = InterleaveMode::Line;
+
+    vector<uint8_t> encodedBuffer(pixels.size() * 2);
+    size_t compressedLength;
+    error_code error = JpegLsEncode(encodedBuffer.data(), encodedBuffer.size(), &compressedLength, pixels.data(), pixels.size(), &params, nullptr);
+    Assert::IsTrue(!error);
+
+    charls_jpegls_decoder* decoder = charls_jpegls_decoder_create();
+    vector<uint8_t> decodedBuffer(pixels.size());
+    error = charls_jpegls_decoder_decode_to_buffer(decoder, decodedBuffer.data(), decodedBuffer.size(), nullptr);
+    Assert::IsTrue(error == jpegls_errc::invalid_argument);
+
+    JlsParameters headerParams{};
+    error = charls_jpegls_decoder_read_header(decoder, encodedBuffer.data(), compressedLength, &headerParams);
+    Assert::IsTrue(!error);
+    Assert::IsTrue(headerParams.width == params.width && headerParams.height == params.height && headerParams.components == componentCount);
+
+    // The parsed header can be decoded multiple times, with and without decoding options.
+    error = charls_jpegls_decoder_decode_to_buffer(decoder, decodedBuffer.data(), decodedBuffer.size(), nullptr);
+    Assert::IsTrue(!error);
+    Assert::IsTrue(decodedBuffer == pixels);
+
+    JlsParameters options{};
+    Assert::IsTrue(charls_jpegls_decoder_set_thread_count(decoder, 2) == jpegls_errc::success);
+    std::fill(decodedBuffer.begin(), decodedBuffer.end(), static_cast<uint8_t>(0));
+    error = charls_jpegls_decoder_decode_to_buffer(decoder, decodedBuffer.data(), decodedBuffer.size(), &options);
+    Assert::IsTrue(!error);
+    Assert::IsTrue(decodedBuffer == pixels);
+
+    error = charls_jpegls_decoder_decode_to_buffer(decoder, decodedBuffer.data(), decodedBuffer.size() - 1, nullptr);
+    Assert::IsTrue(error == jpegls_errc::destination_buffer_too_small);
+
+    charls_jpegls_decoder_destroy(decoder);
+}
+
+
+void TestEstimatedDestinationSize()
+{
+    struct Configuration
+    {
+        int bitsPerSample;
+        int components;
+        InterleaveMode interleaveMode;
+        int allowedLossyError;
+        int restartInterval;
+    };
+    const Configuration configurations[]{
+        {8, 1, InterleaveMode::None, 0, 0},
+        {8, 3, InterleaveMode::Sample, 0, 0},
+        {8, 3, InterleaveMode::None, 0, 7},
+        {12, 3, InterleaveMode::Line, 0, 0},
+        {16, 1, InterleaveMode::None, 0, 5},
+        {8, 3, InterleaveMode::Sample, 0, 1},
+        {16, 1, InterleaveMode::None, 3, 0},
+        {2, 1, InterleaveMode::None, 0, 0}};
+
+    for (const auto& configuration : configurations)
+    {
+        // Noise over the full sample range is the worst case: the encoded image is larger than the pixels.
+        const Size size{37, 23};
+        const int bytesPerSample = configuration.bitsPerSample > 8 ? 2 : 1;
+        const size_t sampleCount = size.cx * size.cy * configuration.components;
+        vector<uint8_t> pixels = MakeSomeNoise(sampleCount * bytesPerSample, 8, 21344);
+        const auto maximumValue = static_cast<uint16_t>((1 << configuration.bitsPerSample) - 1);
+        for (size_t i = 0; i < sampleCount; ++i)
+        {
+            if (bytesPerSample == 1)
+            {
+                pixels[i] = static_cast<uint8_t>(pixels[i] & maximumValue);
+            }
+            else
+            {
+                pixels[2 * i + 1] = static_cast<uint8_t>(pixels[2 * i + 1] & (maximumValue >> 8));
+            }
+        }
+
+        JlsParameters params{};
+        params.width = static_cast<int>(size.cx);
+        params.height = static_cast<int>(size.cy);
+        params.bitsPerSample = configuration.bitsPerSample;
+        params.components = configuration.components;
+        params.interleaveMode = configuration.interleaveMode;
+        params.allowedLossyError = configuration.allowedLossyError;
+
+        size_t estimatedSize;
+        error_code error = charls_jpegls_encoder_get_estimated_destination_size(&params, &estimatedSize);
+        Assert::IsTrue(!error);
+
+        vector<uint8_t> encodedBuffer(estimatedSize);
+        size_t compressedLength;
+        error = EncodeWithRestartInterval(encodedBuffer, compressedLength, pixels, params, configuration.restartInterval);
+        Assert::IsTrue(!error);
+        Assert::IsTrue(compressedLength <= estimatedSize);
+    }
+
+    size_t estimatedSize;
+    JlsParameters params{};
+    error_code error = charls_jpegls_encoder_get_estimated_destination_size(&params, &estimatedSize);
+    Assert::IsTrue(error == jpegls_errc::invalid_argument_width);
+    error = charls_jpegls_encoder_get_estimated_destination_size(nullptr, &estimatedSize);
+    Assert::IsTrue(error == jpegls_errc::invalid_argument);
+    error = charls_jpegls_encoder_get_estimated_destination_size(&params, nullptr);
+    Assert::IsTrue(error == jpegls_errc::invalid_argument);
+}
+
+
+void TestEncodeToGrowingStream()
+{
+    // A stream destination without a fixed size: incompressible noise doesn't fail on a too small buffer.
+    struct GrowingStreamBuffer final : std::basic_streambuf<char>
+    {
+        std::streamsize xsputn(const char* s, std::streamsize count) override
+        {
+            data.insert(data.end(), s, s + count);
+            return count;
+        }
+
+        int_type overflow(int_type ch) override
+        {
+            data.push_back(traits_type::to_char_type(ch));
+            return ch;
+        }
+
+        vector<char> data;
+    };
+
+    const Size size{64, 64};
+    const vector<uint8_t> pixels = MakeSomeNoise(size.cx * size.cy, 8, 21344);
+
+    JlsParameters params{};
+    params.width = static_cast<int>(size.cx);
+    params.height = static_cast<int>(size.cy);
+    params.bitsPerSample = 8;
+    params.components = 1;
+
+    charls_jpegls_encoder* encoder = charls_jpegls_encoder_create();
+    GrowingStreamBuffer stream;
+    size_t bytesWritten;
+    const error_code error = charls_jpegls_encoder_encode_stream(encoder, {&stream, nullptr, 0}, bytesWritten,
+                                                                 FromByteArrayConst(pixels.data(), pixels.size()), params);
+    charls_jpegls_encoder_destroy(encoder);
+    Assert::IsTrue(!error);
+    Assert::IsTrue(bytesWritten == stream.data.size());
+    Assert::IsTrue(bytesWritten > pixels.size());
+
+    vector<uint8_t> decodedBuffer(pixels.size());
+    const error_code decodeError = JpegLsDecode(decodedBuffer.data(), decodedBuffer.size(), stream.data.data(), stream.data.size(), nullptr, nullptr);
+    Assert::IsTrue(!decodeError);
+    Assert::IsTrue(decodedBuffer == pixels);
+}
+
+
+struct CallbackBuffers
+{
+    size_t bufferSize;
+    size_t maximumBufferCount;
+    vector<vector<uint8_t>> buffers;
+    vector<uint8_t> encoded;
+    size_t releasedCount;
+};
+
+
+void* CHARLS_API_CALLING_CONVENTION AcquireCallbackBuffer(void* userContext, size_t* bufferSizeBytes)
+{
+    auto& callbackBuffers = *static_cast<CallbackBuffers*>(userContext);
+    if (callbackBuffers.buffers.size() == callbackBuffers.maximumBufferCount)
+        return nullptr;
+
+    callbackBuffers.buffers.emplace_back(callbackBuffers.bufferSize);
+    *bufferSizeBytes = callbackBuffers.bufferSize;
+    return callbackBuffers.buffers.back().data();
+}
+
+
+void CHARLS_API_CALLING_CONVENTION ReleaseCallbackBuffer(void* userContext, void* buffer, size_t bytesWritten)
+{
+    auto& callbackBuffers = *static_cast<CallbackBuffers*>(userContext);
+    Assert::IsTrue(buffer == callbackBuffers.buffers[callbackBuffers.releasedCount].data());
+    ++callbackBuffers.releasedCount;
+
+    const auto data = static_cast<const uint8_t*>(buffer);
+    callbackBuffers.encoded.insert(callbackBuffers.encoded.end(), data, data + bytesWritten);
+}
+
+
+void TestEncodeToCallback()
+{
+    const Size size{97, 53};
+    const int componentCount = 3;
+    const vector<uint8_t> pixels = MakeSomeNoise(size.cx * size.cy * componentCount, 8, 21344);
+
+    JlsParameters params{};
+    params.width = static_cast<int>(size.cx);
+    params.height = static_cast<int>(size.cy);
+    params.bitsPerSample = 8;
+    params.components = componentCount;
+
+    charls_jpegls_encoder* encoder = charls_jpegls_encoder_create();
+
+    // Buffers smaller and larger than the encoded data of a line, with scans and restart intervals encoded concurrently.
+    const size_t bufferSizes[]{1, 7, 4096, 1 << 20};
+    for (const size_t bufferSize : bufferSizes)
+    {
+        for (const int threadCount : {1, 2})
+        {
+            const int32_t restartInterval = threadCount == 1 ? 0 : 16;
+            Assert::IsTrue(charls_jpegls_encoder_set_thread_count(encoder, threadCount) == jpegls_errc::success);
+            Assert::IsTrue(charls_jpegls_encoder_set_restart_interval(encoder, restartInterval) == jpegls_errc::success);
+
+            vector<uint8_t> expected(pixels.size() * 2);
+            size_t expectedLength;
+            error_code error = EncodeWithRestartInterval(expected, expectedLength, pixels, params, restartInterval);
+            Assert::IsTrue(!error);
+            expected.resize(expectedLength);
+
+            CallbackBuffers callbackBuffers{bufferSize, SIZE_MAX, {}, {}, 0};
+            size_t bytesWritten;
+            error = charls_jpegls_encoder_encode_to_callback(encoder, AcquireCallbackBuffer, ReleaseCallbackBuffer, &callbackBuffers,
+                                                             &bytesWritten, pixels.data(), pixels.size(), &params);
+            Assert::IsTrue(!error);
+            Assert::IsTrue(bytesWritten == expectedLength);
+            Assert::IsTrue(callbackBuffers.releasedCount == callbackBuffers.buffers.size());
+            Assert::IsTrue(callbackBuffers.encoded == expected);
+        }
+    }
+
+    // No more memory: encoding fails and all acquired buffers are released.
+    Assert::IsTrue(charls_jpegls_encoder_set_thread_count(encoder, 0) == jpegls_errc::success);
+    Assert::IsTrue(charls_jpegls_encoder_set_restart_interval(encoder, 0) == jpegls_errc::success);
+    CallbackBuffers callbackBuffers{1024, 2, {}, {}, 0};
+    size_t bytesWritten;
+    const error_code error = charls_jpegls_encoder_encode_to_callback(encoder, AcquireCallbackBuffer, ReleaseCallbackBuffer, &callbackBuffers,
+                                                                      &bytesWritten, pixels.data(), pixels.size(), &params);
+    Assert::IsTrue(error == jpegls_errc::destination_buffer_too_small);
+    Assert::IsTrue(callbackBuffers.releasedCount == 2);
+
+    charls_jpegls_encoder_destroy(encoder);
+}
+
+
+void TestDecodeFragments()
+{
+    const Size size{211, 97};
+    const int componentCount = 3;
+    vector<uint8_t> pixels = MakeSomeNoise(size.cx * size.cy * componentCount, 8, 21344);
+
+    JlsParameters params{};
+    params.width = static_cast<int>(size.cx);
+    params.height = static_cast<int>(size.cy);
+    params.bitsPerSample = 8;
+    params.components = componentCount;
+    params.interleaveMode = InterleaveMode::None;
+
+    vector<uint8_t> encodedBuffer(pixels.size() * 2);
+    size_t compressedLength;
+    error_code error = EncodeWithRestartInterval(encodedBuffer, compressedLength, pixels, params, 10);
+    Assert::IsTrue(!error);
+
+    charls_jpegls_decoder* decoder = charls_jpegls_decoder_create();
+
+    // Fragments of 0 and 1 byte, fragments that split markers and fragments larger than the encoded data of a line.
+    const size_t fragmentSizes[]{0, 1, 3, 64, 65, 1000, 7777};
+    for (const size_t fragmentSize : fragmentSizes)
+    {
+        // Every fragment in its own buffer: reading past the end of a fragment is detected by memory checkers.
+        vector<vector<uint8_t>> fragmentBuffers;
+        vector<charls_buffer_fragment> fragments;
+        for (size_t position = 0; position < compressedLength; position += fragmentSize)
+        {
+            const size_t end = std::min(position + std::max(fragmentSize, static_cast<size_t>(1)), compressedLength);
+            fragmentBuffers.emplace_back(encodedBuffer.begin() + position, encodedBuffer.begin() + end);
+            fragments.push_back({fragmentBuffers.back().data(), fragmentBuffers.back().size()});
+            if (fragmentSize == 0)
+            {
+                fragments.push_back({nullptr, 0});
+                position = end;
+            }
+        }
+
+        vector<uint8_t> decodedBuffer(pixels.size());
+        error = charls_jpegls_decoder_decode_fragments(decoder, decodedBuffer.data(), decodedBuffer.size(), fragments.data(), fragments.size(), nullptr);
+        Assert::IsTrue(!error);
+        Assert::IsTrue(decodedBuffer == pixels);
+    }
+
+    const charls_buffer_fragment truncated[]{{encodedBuffer.data(), compressedLength / 2}};
+    vector<uint8_t> decodedBuffer(pixels.size());
+    error = charls_jpegls_decoder_decode_fragments(decoder, decodedBuffer.data(), decodedBuffer.size(), truncated, 1, nullptr);
+    Assert::IsTrue(!!error);
+
+    charls_jpegls_decoder_destroy(decoder);
+}
+
+
+void TestIncrementalDecoder()
+{
+    const Size size{211, 97};
+    const int componentCount = 3;
+    vector<uint8_t> pixels = MakeSomeNoise(size.cx * size.cy * componentCount, 8, 21344);
+
+    const InterleaveMode interleaveModes[]{InterleaveMode::None, InterleaveMode::Line};
+    for (const InterleaveMode interleaveMode : interleaveModes)
+    {
+        JlsParameters params{};
+        params.width = static_cast<int>(size.cx);
+        params.height = static_cast<int>(size.cy);
+        params.bitsPerSample = 8;
+        params.components = componentCount;
+        params.interleaveMode = interleaveMode;
+
+        vector<uint8_t> encodedBuffer(pixels.size() * 2);
+        size_t compressedLength;
+        error_code error = EncodeWithRestartInterval(encodedBuffer, compressedLength, pixels, params, 10);
+        Assert::IsTrue(!error);
+
+        // Chunks of 1 byte (that split every marker), chunks smaller and larger than the encoded data of a line.
+        const size_t chunkSizes[]{1, 7, 100, 5000};
+        for (const size_t chunkSize : chunkSizes)
+        {
+            charls_jpegls_incremental_decoder* decoder = charls_jpegls_incremental_decoder_create();
+
+            JlsParameters decodedParams{};
+            Assert::IsTrue(charls_jpegls_incremental_decoder_get_parameters(decoder, &decodedParams) == jpegls_errc::source_buffer_too_small);
+
+            vector<uint8_t> decodedBuffer(pixels.size());
+            bool destinationSet = false;
+            int32_t previousProgress = 0;
+            for (size_t position = 0; position < compressedLength; position += chunkSize)
+            {
+                error = charls_jpegls_incremental_decoder_append(decoder, encodedBuffer.data() + position, std::min(chunkSize, compressedLength - position));
+                Assert::IsTrue(!error);
+
+                if (!destinationSet && charls_jpegls_incremental_decoder_get_parameters(decoder, &decodedParams) == jpegls_errc::success)
+                {
+                    Assert::IsTrue(decodedParams.width == params.width && decodedParams.height == params.height && decodedParams.components == componentCount);
+                    error = charls_jpegls_incremental_decoder_set_destination(decoder, decodedBuffer.data(), decodedBuffer.size());
+                    Assert::IsTrue(!error);
+                    destinationSet = true;
+                }
+
+                int32_t completedScanCount;
+                int32_t decodedLineCount;
+                error = charls_jpegls_incremental_decoder_get_progress(decoder, &completedScanCount, &decodedLineCount);
+                Assert::IsTrue(!error);
+                const int32_t progress = completedScanCount * params.height + decodedLineCount;
+                Assert::IsTrue(progress >= previousProgress);
+                previousProgress = progress;
+            }
+
+            // Lines are decoded before all bytes are received.
+            Assert::IsTrue(previousProgress > 0);
+
+            error = charls_jpegls_incremental_decoder_finish(decoder);
+            Assert::IsTrue(!error);
+            Assert::IsTrue(decodedBuffer == pixels);
+
+            charls_jpegls_incremental_decoder_destroy(decoder);
+        }
+
+        // An incomplete stream is reported when it is finished.
+        charls_jpegls_incremental_decoder* decoder = charls_jpegls_incremental_decoder_create();
+        vector<uint8_t> decodedBuffer(pixels.size());
+        error = charls_jpegls_incremental_decoder_append(decoder, encodedBuffer.data(), compressedLength / 2);
+        Assert::IsTrue(!error);
+        Assert::IsTrue(charls_jpegls_incremental_decoder_set_destination(decoder, decodedBuffer.data(), decodedBuffer.size()) == jpegls_errc::success);
+        const jpegls_errc finishError = charls_jpegls_incremental_decoder_finish(decoder);
+        Assert::IsTrue(finishError != jpegls_errc::success);
+        Assert::IsTrue(charls_jpegls_incremental_decoder_append(decoder, encodedBuffer.data(), 1) == finishError);
+        charls_jpegls_incremental_decoder_destroy(decoder);
+    }
+}
+
+
+void TestIncrementalEncoder()
+{
+    const Size size{97, 53};
+    const int componentCount = 3;
+    const vector<uint8_t> pixels = MakeSomeNoise(size.cx * size.cy * componentCount, 8, 21344);
+    const size_t stride = size.cx * componentCount;
+
+    JlsParameters params{};
+    params.width = static_cast<int>(size.cx);
+    params.height = static_cast<int>(size.cy);
+    params.bitsPerSample = 8;
+    params.components = componentCount;
+
+    charls_jpegls_incremental_encoder* encoder = charls_jpegls_incremental_encoder_create();
+    Assert::IsTrue(charls_jpegls_incremental_encoder_set_restart_interval(encoder, -1) == jpegls_errc::invalid_argument_restart_interval);
+    Assert::IsTrue(charls_jpegls_incremental_encoder_set_restart_interval(encoder, 10) == jpegls_errc::success);
+
+    // The encoded stream is identical to the stream of a complete image, independent of the number of pushed lines.
+    const InterleaveMode interleaveModes[]{InterleaveMode::Line, InterleaveMode::Sample};
+    for (const InterleaveMode interleaveMode : interleaveModes)
+    {
+        params.interleaveMode = interleaveMode;
+
+        vector<uint8_t> expected(pixels.size() * 2);
+        size_t expectedLength;
+        error_code error = EncodeWithRestartInterval(expected, expectedLength, pixels, params, 10);
+        Assert::IsTrue(!error);
+        expected.resize(expectedLength);
+
+        for (const int32_t linesPerPush : {1, 7, static_cast<int32_t>(size.cy)})
+        {
+            CallbackBuffers callbackBuffers{100, SIZE_MAX, {}, {}, 0};
+            error = charls_jpegls_incremental_encoder_begin(encoder, &params, AcquireCallbackBuffer, ReleaseCallbackBuffer, &callbackBuffers);
+            Assert::IsTrue(!error);
+
+            for (int32_t line = 0; line < params.height; line += linesPerPush)
+            {
+                const int32_t lineCount = std::min(linesPerPush, params.height - line);
+
+                // Every push uses its own buffer: the encoder doesn't read the lines after the call.
+                const vector<uint8_t> lines(pixels.begin() + line * stride, pixels.begin() + (line + lineCount) * stride);
+                error = charls_jpegls_incremental_encoder_push_lines(encoder, lines.data(), lines.size(), lineCount);
+                Assert::IsTrue(!error);
+            }
+
+            size_t bytesWritten;
+            error = charls_jpegls_incremental_encoder_finish(encoder, &bytesWritten);
+            Assert::IsTrue(!error);
+            Assert::IsTrue(bytesWritten == expectedLength);
+            Assert::IsTrue(callbackBuffers.releasedCount == callbackBuffers.buffers.size());
+            Assert::IsTrue(callbackBuffers.encoded == expected);
+        }
+    }
+
+    // Non interleaved components are encoded in separate scans, that requires the complete image.
+    params.interleaveMode = InterleaveMode::None;
+    CallbackBuffers callbackBuffers{100, SIZE_MAX, {}, {}, 0};
+    Assert::IsTrue(charls_jpegls_incremental_encoder_begin(encoder, &params, AcquireCallbackBuffer, ReleaseCallbackBuffer, &callbackBuffers) ==
+                   jpegls_errc::invalid_argument_interleave_mode);
+
+    // An image can only be finished when all lines are pushed and no more lines than the height can be pushed.
+    params.interleaveMode = InterleaveMode::Line;
+    size_t bytesWritten;
+    Assert::IsTrue(charls_jpegls_incremental_encoder_begin(encoder, &params, AcquireCallbackBuffer, ReleaseCallbackBuffer, &callbackBuffers) == jpegls_errc::success);
+    Assert::IsTrue(charls_jpegls_incremental_encoder_push_lines(encoder, pixels.data(), pixels.size(), params.height - 1) == jpegls_errc::success);
+    Assert::IsTrue(charls_jpegls_incremental_encoder_finish(encoder, &bytesWritten) == jpegls_errc::invalid_operation);
+    Assert::IsTrue(charls_jpegls_incremental_encoder_push_lines(encoder, pixels.data(), pixels.size(), 2) == jpegls_errc::invalid_argument);
+
+    // Destroying the encoder of an unfinished image releases the buffer.
+    charls_jpegls_incremental_encoder_destroy(encoder);
+    Assert::IsTrue(callbackBuffers.releasedCount == callbackBuffers.buffers.size());
+}
+
+
+struct AllocationCounts
+{
+    size_t allocated;
+    size_t freed;
+};
+
+
+void* CHARLS_API_CALLING_CONVENTION CountingAllocate(void* userContext, size_t size)
+{
+    static_cast<AllocationCounts*>(userContext)->allocated++;
+    return std::malloc(size);
+}
+
+
+void CHARLS_API_CALLING_CONVENTION CountingFree(void* userContext, void* memory)
+{
+    static_cast<AllocationCounts*>(userContext)->freed++;
+    std::free(memory);
+}
+
+
+void TestScratchBuffer()
+{
+    struct Image
+    {
+        int bitsPerSample;
+        int componentCount;
+        InterleaveMode interleaveMode;
+        ColorTransformation colorTransformation;
+        int allowedLossyError;
+    };
+
+    // Lossless images use the optimized codecs and the precomputed quantization LUTs, the lossy images compute their LUT.
+    const Image images[]{{8, 3, InterleaveMode::Sample, ColorTransformation::None, 0},
+                         {8, 3, InterleaveMode::Line, ColorTransformation::HP1, 0},
+                         {12, 5, InterleaveMode::None, ColorTransformation::None, 0},
+                         {16, 1, InterleaveMode::None, ColorTransformation::None, 3},
+                         {10, 4, InterleaveMode::Sample, ColorTransformation::None, 2}};
+
+    AllocationCounts counts{};
+    Assert::IsTrue(charls_set_allocator(CountingAllocate, CountingFree, &counts) == jpegls_errc::success);
+
+    charls_jpegls_encoder* encoder = charls_jpegls_encoder_create();
+    charls_jpegls_decoder* decoder = charls_jpegls_decoder_create();
+    Assert::IsTrue(charls_jpegls_encoder_set_thread_count(encoder, 2) == jpegls_errc::success); // Ignored with a scratch buffer.
+    Assert::IsTrue(charls_jpegls_encoder_set_restart_interval(encoder, 8) == jpegls_errc::success);
+    Assert::IsTrue(charls_jpegls_decoder_set_thread_count(decoder, 2) == jpegls_errc::success);
+
+    for (const Image& image : images)
+    {
+        const Size size{113, 37};
+        const size_t sampleCount = size.cx * size.cy * image.componentCount;
+        const vector<uint8_t> pixels = image.bitsPerSample > 8 ? MakeSomeNoise16bit(sampleCount, image.bitsPerSample, 2134) :
+                                                                 MakeSomeNoise(sampleCount, static_cast<size_t>(image.bitsPerSample), 2134);
+
+        JlsParameters params{};
+        params.width = static_cast<int>(size.cx);
+        params.height = static_cast<int>(size.cy);
+        params.bitsPerSample = image.bitsPerSample;
+        params.components = image.componentCount;
+        params.interleaveMode = image.interleaveMode;
+        params.colorTransformation = image.colorTransformation;
+        params.allowedLossyError = image.allowedLossyError;
+
+        vector<uint8_t> expected(pixels.size() * 2);
+        size_t expectedLength;
+        error_code error = EncodeWithRestartInterval(expected, expectedLength, pixels, params, 8);
+        Assert::IsTrue(!error);
+        expected.resize(expectedLength);
+
+        vector<uint8_t> expectedPixels(pixels.size());
+        error = JpegLsDecode(expectedPixels.data(), expectedPixels.size(), expected.data(), expected.size(), nullptr, nullptr);
+        Assert::IsTrue(!error);
+
+        // The calls without scratch buffer allocate with the allocator of the application.
+        Assert::IsTrue(counts.allocated > 0);
+
+        size_t scratchSize;
+        Assert::IsTrue(charls_get_scratch_size(&params, &scratchSize) == jpegls_errc::success);
+        vector<uint8_t> scratch(scratchSize);
+        Assert::IsTrue(charls_jpegls_encoder_set_scratch_buffer(encoder, scratch.data(), scratch.size()) == jpegls_errc::success);
+        Assert::IsTrue(charls_jpegls_decoder_set_scratch_buffer(decoder, scratch.data(), scratch.size()) == jpegls_errc::success);
+
+        // With a scratch buffer of the computed size nothing is allocated, also when a handle is reused.
+        const size_t allocatedCount = counts.allocated;
+        for (int i = 0; i < 2; ++i)
+        {
+            vector<uint8_t> encoded(expected.size());
+            size_t bytesWritten;
+            error = charls_jpegls_encoder_encode(encoder, encoded.data(), encoded.size(), &bytesWritten, pixels.data(), pixels.size(), &params);
+            Assert::IsTrue(!error);
+            Assert::IsTrue(encoded == expected);
+
+            vector<uint8_t> decoded(pixels.size());
+            error = charls_jpegls_decoder_decode(decoder, decoded.data(), decoded.size(), encoded.data(), encoded.size(), &params);
+            Assert::IsTrue(!error);
+            Assert::IsTrue(decoded == expectedPixels);
+        }
+        Assert::IsTrue(counts.allocated == allocatedCount);
+
+        // A too small buffer (smaller than a codec) is reported as not enough memory.
+        Assert::IsTrue(charls_jpegls_encoder_set_scratch_buffer(encoder, scratch.data(), 256) == jpegls_errc::success);
+        vector<uint8_t> encoded(expected.size());
+        size_t bytesWritten;
+        error = charls_jpegls_encoder_encode(encoder, encoded.data(), encoded.size(), &bytesWritten, pixels.data(), pixels.size(), &params);
+        Assert::IsTrue(error == jpegls_errc::not_enough_memory);
+
+        Assert::IsTrue(charls_jpegls_encoder_set_scratch_buffer(encoder, nullptr, 0) == jpegls_errc::success);
+        Assert::IsTrue(charls_jpegls_decoder_set_scratch_buffer(decoder, nullptr, 0) == jpegls_errc::success);
+    }
+
+    charls_jpegls_decoder_destroy(decoder);
+    charls_jpegls_encoder_destroy(encoder);
+    Assert::IsTrue(counts.freed == counts.allocated);
+
+    Assert::IsTrue(charls_set_allocator(CountingAllocate, nullptr, &counts) == jpegls_errc::invalid_argument);
+    Assert::IsTrue(charls_set_allocator(nullptr, nullptr, nullptr) == jpegls_errc::success);
+}
+
+
+void TestSharedQuantizationLut()
+{
+    const Size size{211, 67};
+    const vector<uint8_t> pixels = MakeSomeNoise16bit(size.cx * size.cy, 16, 3245);
+
+    JlsParameters params{};
+    params.width = static_cast<int>(size.cx);
+    params.height = static_cast<int>(size.cy);
+    params.bitsPerSample = 16;
+    params.components = 1;
+    params.allowedLossyError = 2;
+
+    // Custom thresholds that no other test uses: a call with a scratch buffer creates the LUT itself, as it's not cached yet.
+    params.custom.Threshold1 = 20;
+    params.custom.Threshold2 = 40;
+    params.custom.Threshold3 = 80;
+
+    charls_jpegls_encoder* encoder = charls_jpegls_encoder_create();
+    size_t scratchSize;
+    Assert::IsTrue(charls_get_scratch_size(&params, &scratchSize) == jpegls_errc::success);
+    vector<uint8_t> scratch(scratchSize);
+    Assert::IsTrue(charls_jpegls_encoder_set_scratch_buffer(encoder, scratch.data(), scratch.size()) == jpegls_errc::success);
+
+    vector<uint8_t> expected(pixels.size() * 2);
+    size_t expectedLength;
+    error_code error = charls_jpegls_encoder_encode(encoder, expected.data(), expected.size(), &expectedLength, pixels.data(), pixels.size(), &params);
+    Assert::IsTrue(!error);
+    expected.resize(expectedLength);
+    charls_jpegls_encoder_destroy(encoder);
+
+    // Concurrent encoders share the cached LUTs (custom and default thresholds), the encoded data is identical.
+    for (const int32_t threshold1 : {20, 0})
+    {
+        params.custom.Threshold1 = threshold1;
+        params.custom.Threshold2 = threshold1 == 0 ? 0 : 40;
+        params.custom.Threshold3 = threshold1 == 0 ? 0 : 80;
+
+        vector<uint8_t> reference(pixels.size() * 2);
+        size_t referenceLength;
+        error = JpegLsEncode(reference.data(), reference.size(), &referenceLength, pixels.data(), pixels.size(), &params, nullptr);
+        Assert::IsTrue(!error);
+        reference.resize(referenceLength);
+        if (threshold1 != 0)
+        {
+            Assert::IsTrue(reference == expected);
+        }
+
+        vector<vector<uint8_t>> encoded(4, vector<uint8_t>(pixels.size() * 2));
+        vector<size_t> encodedLengths(encoded.size());
+        vector<error_code> errors(encoded.size());
+        vector<std::thread> threads;
+        for (size_t i = 0; i < encoded.size(); ++i)
+        {
+            threads.emplace_back([&, i]
+            {
+                charls_jpegls_encoder* threadEncoder = charls_jpegls_encoder_create();
+                for (int image = 0; image < 3 && !errors[i]; ++image)
+                {
+                    errors[i] = charls_jpegls_encoder_encode(threadEncoder, encoded[i].data(), encoded[i].size(), &encodedLengths[i], pixels.data(), pixels.size(), &params);
+                }
+                charls_jpegls_encoder_destroy(threadEncoder);
+            });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        // The assertions run on the test thread: a failed assertion throws.
+        for (size_t i = 0; i < encoded.size(); ++i)
+        {
+            Assert::IsTrue(!errors[i]);
+            encoded[i].resize(encodedLengths[i]);
+            Assert::IsTrue(encoded[i] == reference);
+        }
+    }
+}
+
+
+void TestLosslessFormats()
+{
+    struct Format
+    {
+        int32_t bitsPerSample;
+        int32_t components;
+        InterleaveMode interleaveMode;
+    };
+
+    // Formats with an optimized lossless codec (10/12/16 bit RGB, 10/12 bit RGBA, 10 bit monochrome, 2 components).
+    const Format formats[]{{10, 3, InterleaveMode::Sample}, {12, 3, InterleaveMode::Sample}, {16, 3, InterleaveMode::Sample},
+                           {10, 4, InterleaveMode::Sample}, {12, 4, InterleaveMode::Sample}, {10, 1, InterleaveMode::None},
+                           {10, 2, InterleaveMode::None}, {12, 2, InterleaveMode::None}};
+
+    const Size size{97, 61};
+    for (const auto& format : formats)
+    {
+        JlsParameters params{};
+        params.width = static_cast<int>(size.cx);
+        params.height = static_cast<int>(size.cy);
+        params.bitsPerSample = format.bitsPerSample;
+        params.components = format.components;
+        params.interleaveMode = format.interleaveMode;
+
+        // Noise with extreme values in the upper half (the errors wrap around), flat areas in the lower half (run mode).
+        const size_t sampleCount = size.cx * size.cy * format.components;
+        const int maximumValue = (1 << format.bitsPerSample) - 1;
+        vector<uint8_t> pixels(sampleCount * 2);
+        srand(4327);
+        for (size_t i = 0; i < sampleCount; ++i)
+        {
+            int value;
+            if (i < sampleCount / 2)
+            {
+                value = rand() % 4 == 0 ? (rand() % 2) * maximumValue : rand() & maximumValue;
+            }
+            else
+            {
+                value = i / (size.cx * format.components * 8) % 2 ? maximumValue : 0;
+            }
+
+            pixels[i * 2] = static_cast<uint8_t>(value);
+            pixels[i * 2 + 1] = static_cast<uint8_t>(value >> 8);
+        }
+
+        vector<uint8_t> encoded(pixels.size() * 2);
+        size_t encodedLength;
+        error_code error = JpegLsEncode(encoded.data(), encoded.size(), &encodedLength, pixels.data(), pixels.size(), &params, nullptr);
+        Assert::IsTrue(!error);
+
+        vector<uint8_t> decoded(pixels.size());
+        error = JpegLsDecode(decoded.data(), decoded.size(), encoded.data(), encodedLength, nullptr, nullptr);
+        Assert::IsTrue(!error);
+        Assert::IsTrue(decoded == pixels);
+    }
+}
+
+
 void TestFailOnTooSmallOutputBuffer()
 {
     auto inputBuffer = MakeSomeNoise(8 * 8, 8, 21344);
@@ -212,6 +1336,26 @@ void TestFailOnTooSmallOutputBuffer()
 }
 
 
+void TestFailOnTooSmallInputBuffer()
+{
+    const auto inputBuffer = MakeSomeNoise(8 * 8, 8, 21344);
+    vector<uint8_t> outputBuffer(1000);
+    size_t compressedLength;
+
+    auto params = JlsParameters();
+    params.components = 1;
+    params.bitsPerSample = 8;
+    params.height = 8;
+    params.width = 8;
+
+    auto result = JpegLsEncode(outputBuffer.data(), outputBuffer.size(), &compressedLength, inputBuffer.data(), inputBuffer.size() - 1, &params, nullptr);
+    Assert::IsTrue(result == jpegls_errc::source_buffer_too_small);
+
+    result = JpegLsEncodeStream(FromByteArray(outputBuffer.data(), outputBuffer.size()), compressedLength, {nullptr, nullptr, 0}, params);
+    Assert::IsTrue(result == jpegls_errc::invalid_argument_source);
+}
+
+
 void TestBgra()
 {
     char input[] = "RGBARGBARGBARGBA1234";
@@ -303,6 +1447,20 @@ void TestDecodeBitStreamWithUnknownJpegMarker()
 }
 
 
+void TestDecodeBitStreamWithRestartMarkerInHeader()
+{
+    const array<uint8_t, 6> encodedData = {
+        0xFF, 0xD8, // Start Of Image (JPEG_SOI)
+        0xFF, 0xD3, // Restart marker (RST3), only valid in the encoded data of a scan
+        0x00, 0x00
+    };
+    array<uint8_t, 1000> output{};
+
+    const auto error = JpegLsDecode(output.data(), output.size(), encodedData.data(), encodedData.size(), nullptr, nullptr);
+    Assert::IsTrue(error == jpegls_errc::unexpected_restart_marker);
+}
+
+
 void TestDecodeRect()
 {
     JlsParameters params{};
@@ -323,6 +1481,85 @@ void TestDecodeRect()
 }
 
 
+void TestDecodeRegion()
+{
+    const Size size{67, 211};
+    const int componentCount = 4;
+    const vector<uint8_t> pixels = MakeSomeNoise(size.cx * size.cy * componentCount, 8, 21344);
+    const int width = static_cast<int>(size.cx);
+    const int height = static_cast<int>(size.cy);
+
+    charls_jpegls_decoder* decoder = charls_jpegls_decoder_create();
+
+    const InterleaveMode interleaveModes[]{InterleaveMode::None, InterleaveMode::Line, InterleaveMode::Sample};
+    for (const InterleaveMode interleaveMode : interleaveModes)
+    {
+        JlsParameters params{};
+        params.width = width;
+        params.height = height;
+        params.bitsPerSample = 8;
+        params.components = componentCount;
+        params.interleaveMode = interleaveMode;
+
+        vector<uint8_t> encodedBuffer(pixels.size() * 2);
+        size_t compressedLength;
+        error_code error = EncodeWithRestartInterval(encodedBuffer, compressedLength, pixels, params, 16);
+        Assert::IsTrue(!error);
+
+        // Strips at the top (decoding stops early), at a restart interval boundary and at the bottom, with subsets of the components.
+        const JlsRect regions[]{{0, 0, width, 1}, {5, 16, 31, 17}, {0, height - 3, width, 3}};
+        for (const JlsRect& region : regions)
+        {
+            for (const uint32_t componentMask : {0x1U, 0x8U, 0x6U, 0xFU})
+            {
+                vector<uint8_t> expected;
+                for (int component = 0; component < componentCount; ++component)
+                {
+                    for (int y = region.Y; y < region.Y + region.Height; ++y)
+                    {
+                        for (int x = region.X; x < region.X + region.Width; ++x)
+                        {
+                            if (interleaveMode == InterleaveMode::None && (componentMask & (1U << component)) != 0)
+                            {
+                                expected.push_back(pixels[(static_cast<size_t>(component) * height + y) * width + x]);
+                            }
+                        }
+                    }
+                }
+
+                for (int y = region.Y; y < region.Y + region.Height && interleaveMode != InterleaveMode::None; ++y)
+                {
+                    for (int x = region.X; x < region.X + region.Width; ++x)
+                    {
+                        for (int component = 0; component < componentCount; ++component)
+                        {
+                            if ((componentMask & (1U << component)) != 0)
+                            {
+                                expected.push_back(pixels[(static_cast<size_t>(y) * width + x) * componentCount + component]);
+                            }
+                        }
+                    }
+                }
+
+                vector<uint8_t> decodedBuffer(expected.size());
+                error = charls_jpegls_decoder_decode_region(decoder, decodedBuffer.data(), decodedBuffer.size(), encodedBuffer.data(), compressedLength,
+                                                            &region, componentMask, nullptr);
+                Assert::IsTrue(!error);
+                Assert::IsTrue(decodedBuffer == expected);
+            }
+        }
+
+        // A component that the image doesn't have can't be selected.
+        vector<uint8_t> decodedBuffer(pixels.size());
+        error = charls_jpegls_decoder_decode_region(decoder, decodedBuffer.data(), decodedBuffer.size(), encodedBuffer.data(), compressedLength,
+                                                    nullptr, 0x10, nullptr);
+        Assert::IsTrue(error == jpegls_errc::invalid_argument);
+    }
+
+    charls_jpegls_decoder_destroy(decoder);
+}
+
+
 void TestEncodeFromStream(const char* file, int offset, int width, int height, int bpp, int componentCount, InterleaveMode ilv, size_t expectedLength)
 {
     basic_filebuf<char> myFile; // On the stack
@@ -596,10 +1833,13 @@ void UnitTest()
         TestConformance();
 
         TestDecodeRect();
+        TestDecodeRegion();
 
         cout << "Test Traits\n";
         TestTraits16bit();
         TestTraits8bit();
+        TestTraitsColor();
+        TestTraitsNearLossless();
 
         cout << "Windows bitmap BGR/BGRA output\n";
         TestBgr();
@@ -609,6 +1849,7 @@ void UnitTest()
         TestTooSmallOutputBuffer();
 
         TestFailOnTooSmallOutputBuffer();
+        TestFailOnTooSmallInputBuffer();
 
         cout << "Test Color transform equivalence on HP images\n";
         TestColorTransforms_HpImages();
@@ -618,11 +1859,29 @@ void UnitTest()
 
         TestNoiseImage();
         TestNoiseImageWithCustomReset();
+        TestRunModeWithChangingAlpha();
+        TestParallelEncodeNoneInterleaved();
+        TestParallelDecodeNoneInterleaved();
+        TestRestartInterval();
+        TestPipelinedDecode();
+        TestPipelinedEncode();
+        TestEncoderDecoderHandles();
+        TestDecoderReadHeaderOnce();
+        TestEstimatedDestinationSize();
+        TestEncodeToGrowingStream();
+        TestEncodeToCallback();
+        TestDecodeFragments();
+        TestIncrementalDecoder();
+        TestIncrementalEncoder();
+        TestScratchBuffer();
+        TestSharedQuantizationLut();
+        TestLosslessFormats();
 
         cout << "Test robustness\n";
         TestDecodeBitStreamWithNoMarkerStart();
         TestDecodeBitStreamWithUnsupportedEncoding();
         TestDecodeBitStreamWithUnknownJpegMarker();
+        TestDecodeBitStreamWithRestartMarkerInHeader();
     }
     catch (const UnitTestException&)
     {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../src/util.h"
+#include "../src/intrinsics.h"
 #include <vector>
 #include <string>
 #include <sstream>
@@ -83,5 +83,35 @@ namespace CharLSUnitTest
                 Assert::AreEqual(inData[i].val, actual);
             }
         }
+
+        TEST_METHOD(DecodeEncodedDenseFFPattern)
+        {
+            // Many set bits cause a stuffed 0xFF byte every few bytes: this exercises the bulk read path.
+            uint8_t encBuf[1000];
+            const JlsParameters params = { 0 };
+
+            EncoderStrategyTester encoder(params);
+
+            ByteStreamInfo stream;
+            stream.rawStream = nullptr;
+            stream.rawData = encBuf;
+            stream.count = sizeof(encBuf);
+            encoder.InitForward(stream);
+
+            for (int32_t i = 0; i < 256; i++)
+            {
+                encoder.AppendToBitStreamForward(0xFFF0 | (i & 0xF), 16);
+                encoder.AppendToBitStreamForward(i & 0x3F, 7);
+            }
+            encoder.EndScanForward();
+
+            const auto length = encoder.GetLengthForward();
+            DecoderStrategyTester dec(params, encBuf, length);
+            for (int32_t i = 0; i < 256; i++)
+            {
+                Assert::AreEqual(0xFFF0 | (i & 0xF), dec.Read(16));
+                Assert::AreEqual(i & 0x3F, dec.Read(7));
+            }
+        }
     };
 }
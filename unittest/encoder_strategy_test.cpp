@@ -52,10 +52,10 @@ namespace CharLSUnitTest
             strategy.AppendToBitStreamForward(0xffff, 16);
             strategy.AppendToBitStreamForward(0xffff, 16);
 
-            // Buffer is full with FFs and _isFFWritten = true: Flush can only write 30 date bits.
+            // Previous byte is 0xFF and _isFFWritten = true: the next byte can only contain 7 data bits.
             strategy.AppendToBitStreamForward(0x3, 31);
 
-            strategy.FlushForward();
+            strategy.EndScanForward();
 
             // Verify output.
             Assert::AreEqual(static_cast<size_t>(13), strategy.GetLengthForward());
@@ -74,5 +74,33 @@ namespace CharLSUnitTest
             Assert::AreEqual(static_cast<uint8_t>(0xC0), data[12]);
             Assert::AreEqual(static_cast<uint8_t>(0x77), data[13]);
         }
+
+        TEST_METHOD(AppendToBitStream32Bits)
+        {
+            JlsParameters params;
+
+            EncoderStrategyTester strategy(params);
+
+            uint8_t data[1024];
+            data[5] = 0x77; // marker byte to detect overruns.
+
+            ByteStreamInfo stream;
+            stream.rawStream = nullptr;
+            stream.rawData = data;
+            stream.count = sizeof(data);
+            strategy.InitForward(stream);
+
+            strategy.AppendToBitStreamForward(0xFFFFFFFF, 32);
+            strategy.EndScanForward();
+
+            // Verify output.
+            Assert::AreEqual(static_cast<size_t>(5), strategy.GetLengthForward());
+            Assert::AreEqual(static_cast<uint8_t>(0xFF), data[0]);
+            Assert::AreEqual(static_cast<uint8_t>(0x7F), data[1]); // extra 0 bit.
+            Assert::AreEqual(static_cast<uint8_t>(0xFF), data[2]);
+            Assert::AreEqual(static_cast<uint8_t>(0x7F), data[3]); // extra 0 bit.
+            Assert::AreEqual(static_cast<uint8_t>(0xC0), data[4]);
+            Assert::AreEqual(static_cast<uint8_t>(0x77), data[5]);
+        }
     };
 }
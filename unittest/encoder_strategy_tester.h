@@ -31,7 +31,7 @@ class EncoderStrategyTester final : charls::EncoderStrategy
         Init(info);
     }
 
-    void AppendToBitStreamForward(int32_t value, int32_t length)
+    void AppendToBitStreamForward(uint32_t value, int32_t length)
     {
         AppendToBitStream(value, length);
     }